@@ -170,6 +170,8 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -11,6 +11,7 @@
 
 #include "vertex_data_textures.h"
 #include "../camera.h"
+#include "../frame_uniforms.h"
 
 const char* vertShaderPath = "shader/multiple_lights.vs";
 const char* fragShaderPath = "shader/multiple_lights.fs";
@@ -22,6 +23,7 @@ int screenHeight = 600;
 
 Shader* lightingShader = nullptr;
 Shader* lampShader = nullptr;
+FrameUniforms* frameUniforms = nullptr;
 
 unsigned int VBO;
 unsigned int VAO;
@@ -89,6 +91,18 @@ void prepareDraw() {
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
+    // Shared camera & light uniforms, only the spot light follows the camera
+    frameUniforms = new FrameUniforms();
+    frameUniforms->attach(*lightingShader);
+    frameUniforms->setDirLight(glm::vec3(-0.2f, -1.0f, -0.3f),
+                               glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(1.0f));
+    frameUniforms->lights.pointCount = 4;
+    for (int i = 0; i < 4; i++) {
+        frameUniforms->setPointLight(i, pointLightPositions[i],
+                                     glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(1.0f),
+                                     1.0f, 0.09f, 0.032f);
+    }
+
     // Create VBO, VAO
     glGenBuffers(1, &VBO);
     glGenVertexArrays(1, &VAO);
@@ -120,42 +134,13 @@ void drawStaff() {
     glm::mat4 projection;
     projection = glm::perspective(glm::radians(camera->zoom), (float) screenWidth / screenHeight, 0.1f, 100.0f);
 
-    // Pass the transform matrixs
-    lightingShader->setMat4("view", camera->getViewMatrix());
-    lightingShader->setMat4("projection", projection);
-
-    // Lighting
-    lightingShader->setVec3("viewPos", camera->position);
-
-    lightingShader->setVec3("dirLight.ambient",  0.2f, 0.2f, 0.2f);
-    lightingShader->setVec3("dirLight.diffuse",  0.5f, 0.5f, 0.5f);
-    lightingShader->setVec3("dirLight.specular", 1.0f, 1.0f, 1.0f);
-    lightingShader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-
-    for (int i = 0; i < 4; i++) {
-        std::stringstream ss;
-        ss << "pointLights[" << i << "]";
-        std::string uni_name;
-        ss >> uni_name;
-        lightingShader->setVec3(uni_name + ".ambient",  0.2f, 0.2f, 0.2f);
-        lightingShader->setVec3(uni_name + ".diffuse",  0.5f, 0.5f, 0.5f);
-        lightingShader->setVec3(uni_name + ".specular", 1.0f, 1.0f, 1.0f);
-        lightingShader->setVec3(uni_name + ".position", pointLightPositions[i]);
-        lightingShader->setFloat(uni_name + ".constant",  1.0f);
-        lightingShader->setFloat(uni_name + ".linear",    0.09f);
-        lightingShader->setFloat(uni_name + ".quadratic", 0.032f);
-    }
-
-    lightingShader->setVec3("spotLight.ambient",  0.2f, 0.2f, 0.2f);
-    lightingShader->setVec3("spotLight.diffuse",  0.5f, 0.5f, 0.5f);
-    lightingShader->setVec3("spotLight.specular", 1.0f, 1.0f, 1.0f);
-    lightingShader->setVec3("spotLight.position",  camera->position);
-    lightingShader->setVec3("spotLight.direction", camera->front);
-    lightingShader->setFloat("spotLight.cutOff",   glm::cos(glm::radians(12.5f)));
-    lightingShader->setFloat("spotLight.outerCutOff",   glm::cos(glm::radians(17.5f)));
-    lightingShader->setFloat("spotLight.constant",  1.0f);
-    lightingShader->setFloat("spotLight.linear",    0.09f);
-    lightingShader->setFloat("spotLight.quadratic", 0.032f);
+    // Camera & lighting, one buffer update for every program
+    frameUniforms->setCamera(camera->getViewMatrix(), projection, camera->position);
+    frameUniforms->setSpotLight(camera->position, camera->front,
+                                glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(17.5f)),
+                                glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(1.0f),
+                                1.0f, 0.09f, 0.032f);
+    frameUniforms->upload();
 
     // Material
     lightingShader->setInt("material.diffuse", 0);
@@ -170,12 +155,13 @@ void drawStaff() {
     // Drawing
     glBindVertexArray(VAO);
     glm::mat4 model;    
+    UniformHandle modelLoc = lightingShader->uniform("model");
     for (int i = 0; i < 10; i++) {
         glm::mat4 model;
         model = glm::translate(model, cubePositions[i]);
         float angle = 20.0f * i;
         model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-        lightingShader->setMat4("model", model);
+        lightingShader->setMat4(modelLoc, model);
 
         glDrawArrays(GL_TRIANGLES, 0, 36);
     }
@@ -248,6 +234,8 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -261,12 +249,19 @@ int main() {
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+#ifdef PRINT_UNIFORM_STATS
+        // Build with -DSHADER_NO_UNIFORM_CACHE to compare against the old path
+        std::cout << "glGetUniformLocation calls per frame: " << shaderLocationQueries << std::endl;
+        shaderLocationQueries = 0;
+#endif
+
         // Swap double buffer
         glfwSwapBuffers(window);
         // Deal with the events
         glfwPollEvents();    
     }
 
+    delete frameUniforms;
     delete lightingShader;
     glfwTerminate();
     return 0;
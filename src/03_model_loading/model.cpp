@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -11,7 +12,11 @@
 #include "../model.h"
 
 #include "../camera.h"
+#include "../frame_uniforms.h"
 #include "vertex_data_textures.h"
+#ifdef PRINT_ALLOC_STATS
+#include "../alloc_stats.h"
+#endif
 
 const char* vertShaderPath = "shader/model.vs";
 const char* fragShaderPath = "shader/model.fs";
@@ -23,6 +28,9 @@ int screenHeight = 600;
 
 Shader* lightingShader = nullptr;
 Shader* lampShader = nullptr;
+UniformHandle shininessLoc;
+unsigned long shininessRevision = 0;
+FrameUniforms* frameUniforms = nullptr;
 
 unsigned int VBO;
 unsigned int VAO;
@@ -53,6 +61,23 @@ void prepareDraw() {
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
+    // Shared camera & light uniforms, only the spot light follows the camera
+    float dirSpec = 0.8f;
+    float pointSpec = 0.8f;
+    frameUniforms = new FrameUniforms();
+    frameUniforms->attach(*lightingShader);
+    frameUniforms->attach(*lampShader);
+    frameUniforms->setDirLight(glm::vec3(-0.2f, -1.0f, -0.3f),
+                               glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(dirSpec));
+    // the Lights block holds at most FRAME_MAX_POINT_LIGHTS
+    size_t pointCount = std::min(pointLightPositions.size(), (size_t) FRAME_MAX_POINT_LIGHTS);
+    frameUniforms->lights.pointCount = pointCount;
+    for (size_t i = 0; i < pointCount; i++) {
+        frameUniforms->setPointLight(i, pointLightPositions[i],
+                                     glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(pointSpec),
+                                     1.0f, 0.09f, 0.032f);
+    }
+
     // Create VBO, VAO
     glGenBuffers(1, &VBO);
     glGenVertexArrays(1, &lightVAO);
@@ -73,65 +98,38 @@ void drawStaff() {
     glm::mat4 projection;
     projection = glm::perspective(glm::radians(camera->zoom), (float) screenWidth / screenHeight, 0.1f, 100.0f);
 
-    // Pass the transform matrixs
-    lightingShader->setMat4("view", camera->getViewMatrix());
-    lightingShader->setMat4("projection", projection);
-
-    // Lighting
-    float dirSpec = 0.8f;
-    float pointSpec = 0.8f;
+    // Camera & lighting, one buffer update for both programs
     float spotSpec = 0.8f;
-
-    lightingShader->setVec3("viewPos", camera->position);
-
-    lightingShader->setVec3("dirLight.ambient",  0.2f, 0.2f, 0.2f);
-    lightingShader->setVec3("dirLight.diffuse",  0.5f, 0.5f, 0.5f);
-    lightingShader->setVec3("dirLight.specular", dirSpec, dirSpec, dirSpec);
-    lightingShader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-
-    lightingShader->setInt("pointCount", pointLightPositions.size());
-    for (int i = 0; i < 4; i++) {
-        std::string uni_name = "pointLights[" + std::to_string(i) + "]";
-        lightingShader->setVec3(uni_name + ".ambient",  0.2f, 0.2f, 0.2f);
-        lightingShader->setVec3(uni_name + ".diffuse",  0.5f, 0.5f, 0.5f);
-        lightingShader->setVec3(uni_name + ".specular", pointSpec, pointSpec, pointSpec);
-        lightingShader->setVec3(uni_name + ".position", pointLightPositions[i]);
-        lightingShader->setFloat(uni_name + ".constant",  1.0f);
-        lightingShader->setFloat(uni_name + ".linear",    0.09f);
-        lightingShader->setFloat(uni_name + ".quadratic", 0.032f);
+    frameUniforms->setCamera(camera->getViewMatrix(), projection, camera->position);
+    frameUniforms->setSpotLight(camera->position, camera->front,
+                                glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(17.5f)),
+                                glm::vec3(0.2f), glm::vec3(0.5f), glm::vec3(spotSpec),
+                                1.0f, 0.09f, 0.032f);
+    frameUniforms->upload();
+
+    // Material, looked up again whenever a reload rebuilt the program
+    if (shininessRevision != lightingShader->revision()) {
+        shininessRevision = lightingShader->revision();
+        shininessLoc = lightingShader->uniform("material.shininess");
     }
-
-    lightingShader->setVec3("spotLight.ambient",  0.2f, 0.2f, 0.2f);
-    lightingShader->setVec3("spotLight.diffuse",  0.5f, 0.5f, 0.5f);
-    lightingShader->setVec3("spotLight.specular", spotSpec, spotSpec, spotSpec);
-    lightingShader->setVec3("spotLight.position",  camera->position);
-    lightingShader->setVec3("spotLight.direction", camera->front);
-    lightingShader->setFloat("spotLight.cutOff",   glm::cos(glm::radians(12.5f)));
-    lightingShader->setFloat("spotLight.outerCutOff",   glm::cos(glm::radians(17.5f)));
-    lightingShader->setFloat("spotLight.constant",  1.0f);
-    lightingShader->setFloat("spotLight.linear",    0.09f);
-    lightingShader->setFloat("spotLight.quadratic", 0.032f);
-
-    // Material
-    lightingShader->setFloat("material.shininess", 64.0f);
+    lightingShader->setFloat(shininessLoc, 64.0f);
 
     // Drawing
     glm::mat4 modelMat = glm::mat4(1.0f);
     modelMat = glm::translate(modelMat, glm::vec3(0.0f, -1.75f, 0.0f)); // translate it down so it's at the center of the scene
     modelMat = glm::scale(modelMat, glm::vec3(0.2f, 0.2f, 0.2f));
     lightingShader->setMat4("model", modelMat);
-    model->draw(*lightingShader);
+    // Meshes whose bounds are out of view are skipped
+    model->draw(*lightingShader, Frustum(projection * camera->getViewMatrix() * modelMat));
 
     // Lamp cube
     lampShader->use();
 
-    for (int i = 0; i < pointLightPositions.size(); i++) {
+    for (size_t i = 0; i < pointLightPositions.size(); i++) {
         modelMat = glm::mat4();
         modelMat = glm::translate(modelMat, pointLightPositions[i]);
         modelMat = glm::scale(modelMat, glm::vec3(0.2f));
         lampShader->setMat4("model", modelMat);
-        lampShader->setMat4("view", camera->getViewMatrix());
-        lampShader->setMat4("projection", projection);
 
         glBindVertexArray(lightVAO);
         glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -190,13 +188,32 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Draw
+#ifdef PRINT_ALLOC_STATS
+        unsigned long allocations = heapAllocations;
+        unsigned long allocatedBytes = heapAllocatedBytes;
+#endif
         drawStaff();
+#ifdef PRINT_ALLOC_STATS
+        // Should stay at 0: meshes are drawn by reference, nothing is built per frame
+        std::cout << "Heap allocations in drawStaff: " << heapAllocations - allocations
+                  << " (" << heapAllocatedBytes - allocatedBytes << " bytes)" << std::endl;
+#endif
+#ifdef PRINT_BIND_STATS
+        // Build with -DMESH_NO_ARENA to compare against one VAO and buffer pair per mesh
+        std::cout << "Per frame: " << meshDrawStats.vertexArrayBinds << " VAO binds, "
+                  << meshDrawStats.textureBinds << " texture binds, " << meshDrawStats.drawCalls
+                  << " draw calls, " << meshDrawStats.meshesVisible << " meshes visible, "
+                  << meshDrawStats.meshesCulled << " culled" << std::endl;
+        meshDrawStats = MeshDrawStats();
+#endif
 
         // Frame calc
         float currentFrame = glfwGetTime();
@@ -209,6 +226,8 @@ int main() {
         glfwPollEvents();    
     }
 
+    delete model;
+    delete frameUniforms;
     delete lightingShader;
     glfwTerminate();
     return 0;
@@ -1,7 +1,5 @@
 #version 330 core
 
-#define NR_POINT_LIGHTS 10
-
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_diffuse2;
@@ -11,40 +9,7 @@ struct Material {
     float     shininess;
 };
 
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-
-    float constant;
-    float linear;
-    float quadratic;
-};
+#include "frame_uniforms.glsl"
 
 in vec3 Normal;
 in vec3 FragPos;
@@ -52,12 +17,7 @@ in vec2 TexCoords;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
 uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform int pointCount;
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 
@@ -8,8 +8,8 @@ out vec3 FragPos;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "frame_uniforms.glsl"
 
 void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
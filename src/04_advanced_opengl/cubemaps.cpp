@@ -49,9 +49,10 @@ vector<std::string> faces {
 };
 
 void prepareDraw() {
-    // Create shader
-    shader = new Shader(vertShaderPath, fragShaderPath);
-    skyboxShader = new Shader(vertScreenShaderPath, fragScreenShaderPath);
+    // Create shader, compiled while the rest is loading
+    ShaderBatch shaders;
+    shader = shaders.add(vertShaderPath, fragShaderPath);
+    skyboxShader = shaders.add(vertScreenShaderPath, fragScreenShaderPath);
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
@@ -84,6 +85,7 @@ void prepareDraw() {
     model = new Model("../03_model_loading/model/nanosuit/nanosuit.obj");
 
     // shader
+    shaders.finish();
     shader->use();
     shader->setInt("texture1", 0);
 }
@@ -176,6 +178,8 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
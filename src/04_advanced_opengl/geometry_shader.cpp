@@ -31,17 +31,20 @@ float lastY = screenHeight / 2;
 bool firstMouse = true;
 
 void prepareDraw() {
-    // Create shader
-    shader = new Shader("shader/geometry_shader.vs",
-                        "shader/geometry_shader.fs");
+    // Create shader, compiled while the model is loading
+    ShaderBatch shaders;
+    shader = shaders.add("shader/geometry_shader.vs",
+                         "shader/geometry_shader.fs");
     normalDisplayShader = 
-            new Shader("shader/normalDisplayShader.vs",
+            shaders.add("shader/normalDisplayShader.vs",
                         "shader/normalDisplayShader.gs",
                         "shader/normalDisplayShader.fs");
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
     model = new Model("../03_model_loading/model/nanosuit/nanosuit.obj");
+
+    shaders.finish();
 }
 
 void drawStaff() {
@@ -119,6 +122,8 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -11,6 +11,12 @@
 #include "../model.h"
 #include "../camera.h"
 #include "../common_draw.h"
+#include "../instance_cull.h"
+#include "../asteroid_belt.h"
+#include "../buffer_ring.h"
+#ifdef PRINT_MEMORY_STATS
+#include "../mem_stats.h"
+#endif
 
 int screenWidth = 1280;
 int screenHeight = 720;
@@ -25,6 +31,10 @@ GLuint instanceVBO;
 
 Model* planet = nullptr;
 Model* rock = nullptr;
+GeometryArena* rockArena = nullptr;
+InstanceCuller* rockCuller = nullptr;
+AsteroidBelt* rockBelt = nullptr;
+BufferRing* rockRing = nullptr;
 
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
@@ -34,79 +44,135 @@ float lastX = screenWidth / 2;
 float lastY = screenHeight / 2;
 bool firstMouse = true;
 
-glm::mat4 *modelMatrices;
-unsigned int amount = 100000;
+// Build with -DROCK_COUNT=100000 for the original field
+#ifndef ROCK_COUNT
+#define ROCK_COUNT 1000000
+#endif
+
+unsigned int amount = ROCK_COUNT;
+// A rock is a position, a scale and a quaternion, 24 bytes instead of a 64 byte matrix;
+// build with -DROCKS_MATRIX_INSTANCES for matrices, which also take non-uniform scales
+#ifdef ROCKS_MATRIX_INSTANCES
+InstanceFormat rockFormat = INSTANCE_MATRIX;
+#else
+InstanceFormat rockFormat = INSTANCE_COMPACT;
+#endif
 float radius = 150.0f;
 float offset = 25.0f;
 
+#ifdef PRINT_CULL_STATS
+// Per frame CPU cost of animated rocks, summed between reports
+double rockUpdateMs = 0.0;
+double rockWaitMs = 0.0;
+#endif
+
+// Every rock where the belt's time puts it, on the pool
+void generateRocks(void *instances) {
+    if (rockFormat == INSTANCE_COMPACT)
+        rockBelt->generate((CompactInstance *) instances, &threadPool());
+    else
+        rockBelt->generate((glm::mat4 *) instances, &threadPool());
+}
+
+// Points the rock meshes straight at the instances, `first` bytes into `buffer`
+void setupRockAttributes(GLuint buffer, GLintptr first) {
+    glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    for (unsigned int i = 0; i < rock->meshes.size(); i++) {
+        unsigned int VAO = rock->meshes[i].getVaoName();
+        glBindVertexArray(VAO);
+        // 顶点属性
+        setupInstanceAttributes(rockFormat, 3, 1, first);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
 void prepareDraw() {
-    // Create shader
-    shader = new Shader("shader/geometry_shader.vs",
-                        "shader/instancing.fs");
-    instanceShader = new Shader("shader/instancing.vs", 
-                                "shader/instancing.fs");
+    // Create shader, compiled while the models are loading
+    ShaderBatch shaders;
+    shader = shaders.add("shader/geometry_shader.vs",
+                         "shader/instancing.fs");
+    instanceShader = shaders.add({GL_VERTEX_SHADER, GL_FRAGMENT_SHADER},
+                                 {"shader/instancing.vs", "shader/instancing.fs"}, instanceDefines(rockFormat));
 
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
-    // Model
+    // Model, build with -DMESH_GPU_RESIDENT to keep the meshes in video memory only
+#ifdef PRINT_MEMORY_STATS
+    printResidentSet("before loading models");
+#endif
     planet = new Model("model/planet/planet.obj");
-    rock = new Model("model/rock/rock.obj");
-
-    // Calc
-    modelMatrices = new glm::mat4[amount];
-    srand(glfwGetTime()); // 初始化随机种子
-    for(unsigned int i = 0; i < amount; i++) {
-        glm::mat4 model;
-        // 1. 位移：分布在半径为 'radius' 的圆形上，偏移的范围是 [-offset, offset]
-        float angle = (float)i / (float)amount * 360.0f;
-        float displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float x = sin(angle) * radius + displacement;
-        displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float y = displacement * 0.4f; // 让行星带的高度比x和z的宽度要小
-        displacement = (rand() % (int)(2 * offset * 100)) / 100.0f - offset;
-        float z = cos(angle) * radius + displacement;
-        model = glm::translate(model, glm::vec3(x, y, z));
-
-        // 2. 缩放：在 0.05 和 0.25f 之间缩放
-        float scale = (rand() % 20) / 100.0f + 0.05;
-        model = glm::scale(model, glm::vec3(scale));
-
-        // 3. 旋转：绕着一个（半）随机选择的旋转轴向量进行随机的旋转
-        float rotAngle = (rand() % 360);
-        model = glm::rotate(model, rotAngle, glm::vec3(0.4f, 0.6f, 0.8f));
-
-        // 4. 添加到矩阵的数组中
-        modelMatrices[i] = model;
-    }
-    // 顶点缓冲对象
+    // The rock gets an arena of its own, the instance attributes below go on its VAO
+    rockArena = new GeometryArena(1 << 20);
+    rock = new Model("model/rock/rock.obj", MODEL_KEEP_CPU_DATA, &threadPool(), MODEL_OPTIMIZE_MESHES,
+                     VERTEX_FLOAT, rockArena);
+#ifdef PRINT_MEMORY_STATS
+    printResidentSet("after loading models");
+    std::cout << "Mesh data kept in memory: " << planet->cpuBytes() + rock->cpuBytes() << " bytes" << std::endl;
+#endif
+
+    rockBelt = new AsteroidBelt(amount, radius, offset);
+    GLsizeiptr bufferSize = amount * instanceSize(rockFormat);
+#ifdef ROCKS_ANIMATED
+    // Build with -DROCKS_ANIMATED to move the rocks, rewritten every frame into a ring of
+    // three regions of one persistently mapped buffer (or an orphaned one, see buffer_ring.h)
+    rockRing = new BufferRing(bufferSize);
+    unsigned int buffer = rockRing->buffer();
+#ifdef PRINT_CULL_STATS
+    std::cout << amount << " animated rocks (" << bufferSize << " bytes a frame), "
+              << (rockRing->persistent() ? "persistent mapped ring" : "orphaned buffer") << std::endl;
+#endif
+#else
+    // Calc: the instances are generated on the pool straight into the mapped buffer
+#ifdef PRINT_CULL_STATS
+    double generateStart = glfwGetTime();
+#endif
     unsigned int buffer;
     glGenBuffers(1, &buffer);
     glBindBuffer(GL_ARRAY_BUFFER, buffer);
-    glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), &modelMatrices[0], GL_STATIC_DRAW);
-
-    for (unsigned int i = 0; i < rock->meshes.size(); i++) {
-        unsigned int VAO = rock->meshes[i].getVaoName();
-        glBindVertexArray(VAO);
-        // 顶点属性
-        GLsizei vec4Size = sizeof(glm::vec4);
-        glEnableVertexAttribArray(3); 
-        glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)0);
-        glEnableVertexAttribArray(4); 
-        glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(vec4Size));
-        glEnableVertexAttribArray(5); 
-        glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(2 * vec4Size));
-        glEnableVertexAttribArray(6); 
-        glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, 4 * vec4Size, (void*)(3 * vec4Size));
-
-        glVertexAttribDivisor(3, 1);
-        glVertexAttribDivisor(4, 1);
-        glVertexAttribDivisor(5, 1);
-        glVertexAttribDivisor(6, 1);
+    glBufferData(GL_ARRAY_BUFFER, bufferSize, NULL, GL_STATIC_DRAW);
+    void *instances = glMapBufferRange(GL_ARRAY_BUFFER, 0, bufferSize, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (instances) {
+        generateRocks(instances);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+#ifdef PRINT_CULL_STATS
+    std::cout << amount << " rocks (" << bufferSize << " bytes) in " << (glfwGetTime() - generateStart) * 1000.0 << " ms on "
+              << threadPool().size() + 1 << " threads" << std::endl;
+#endif
+#endif
+
+#ifndef ROCKS_NO_CULLING
+    // Only the rocks in view are drawn, culled and packed on the GPU every frame
+    rockCuller = new InstanceCuller(shaders, buffer, amount, rock->meshes, rockFormat);
+#else
+    // Build with -DROCKS_NO_CULLING to draw every rock, as before
+    setupRockAttributes(buffer, 0);
+#endif
+
+    shaders.finish();
+}
 
-        glBindVertexArray(0);
+#ifdef ROCKS_ANIMATED
+// This frame's rocks into the next region of the ring, which the GPU is done with
+void updateRocks() {
+    double updateStart = glfwGetTime();
+    void *instances = rockRing->map();
+    if (instances) {
+        rockBelt->time = (float) updateStart;
+        generateRocks(instances);
+        rockRing->unmap();
     }
+#ifdef ROCKS_NO_CULLING
+    setupRockAttributes(rockRing->buffer(), rockRing->offset());
+#endif
+#ifdef PRINT_CULL_STATS
+    rockUpdateMs += (glfwGetTime() - updateStart) * 1000.0;
+    rockWaitMs += rockRing->waitMs();
+#endif
 }
+#endif
 
 void drawStaff() {
     // 绘制行星
@@ -114,6 +180,14 @@ void drawStaff() {
 
     glm::mat4 projection = glm::perspective(glm::radians(camera->zoom), (float) screenWidth / screenHeight, 0.1f, 300.0f);
     glm::mat4 view = camera->getViewMatrix();
+#ifdef ROCKS_ANIMATED
+    updateRocks();
+#endif
+#ifndef ROCKS_NO_CULLING
+    // Culling runs while the planet is drawn
+    rockCuller->cull(projection * view, rockRing ? rockRing->offset() : 0);
+    shader->use();
+#endif
     shader->setMat4("projection", projection);
     shader->setMat4("view", view);
 
@@ -127,12 +201,16 @@ void drawStaff() {
     instanceShader->use();
     instanceShader->setMat4("projection", projection);
     instanceShader->setMat4("view", view);
-    for (int i = 0; i < rock->meshes.size(); i++) {
-        glBindVertexArray(rock->meshes[i].getVaoName());
-        glDrawElementsInstanced(
-            GL_TRIANGLES, rock->meshes[i].indices.size(), GL_UNSIGNED_INT, 0, amount
-        );
-    }
+#ifndef ROCKS_NO_CULLING
+    rockCuller->draw();
+#else
+    for (size_t i = 0; i < rock->meshes.size(); i++)
+        rock->meshes[i].drawInstanced(amount);
+#endif
+#ifdef ROCKS_ANIMATED
+    // The region is free again once everything above has run
+    rockRing->fence();
+#endif
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
@@ -184,11 +262,20 @@ int main() {
 
     // Prepare for drawing
     prepareDraw();
+
+#ifdef PRINT_CULL_STATS
+    // Build with -DROCKS_NO_CULLING, -DINSTANCE_CULL_FEEDBACK, -DROCKS_MATRIX_INSTANCES,
+    // -DROCKS_ANIMATED or -DBUFFER_RING_ORPHAN to compare
+    float statsStart = glfwGetTime();
+    int statsFrames = 0;
+#endif
     
     // Start render loop
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -201,6 +288,35 @@ int main() {
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+#ifdef PRINT_CULL_STATS
+        statsFrames++;
+        if (currentFrame - statsStart >= 1.0f) {
+            std::cout << amount << " rocks, ";
+            // Instance bytes a frame: culling reads every rock and writes the visible ones,
+            // which each rock mesh reads again
+            size_t rockSize = instanceSize(rockFormat), instanceBytes = amount * rockSize;
+#ifndef ROCKS_NO_CULLING
+            // On the compute path reading the count back waits for the GPU, once a second only
+            GLuint visible = rockCuller->visibleCount();
+            std::cout << visible << " visible ("
+                      << (rockCuller->usesCompute() ? "compute" : "transform feedback") << "), ";
+            instanceBytes += visible * rockSize * (1 + rock->meshes.size());
+#else
+            instanceBytes *= rock->meshes.size();
+#endif
+            std::cout << instanceBytes / (1024.0 * 1024.0) << " MB of instances, ";
+#ifdef ROCKS_ANIMATED
+            // Writing the rocks on the CPU, and how much of it was waiting for the GPU
+            std::cout << rockUpdateMs / statsFrames << " ms updating (" << rockWaitMs / statsFrames << " ms waiting), ";
+            rockUpdateMs = 0.0;
+            rockWaitMs = 0.0;
+#endif
+            std::cout << (currentFrame - statsStart) * 1000.0f / statsFrames << " ms per frame" << std::endl;
+            statsStart = currentFrame;
+            statsFrames = 0;
+        }
+#endif
+
         // Swap double buffer
         glfwSwapBuffers(window);
         // Deal with the events
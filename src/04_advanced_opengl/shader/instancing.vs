@@ -1,7 +1,19 @@
 #version 330 core
+
+// COMPACT_INSTANCES: 1 when each rock is a 24 byte CompactInstance (instance_format.h)
+// instead of a mat4
+#ifndef COMPACT_INSTANCES
+#define COMPACT_INSTANCES 0
+#endif
+
 layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoords;
+#if COMPACT_INSTANCES
+layout (location = 3) in vec4 instancePositionScale;
+layout (location = 4) in vec4 instanceRotation;
+#else
 layout (location = 3) in mat4 instanceMatrix;
+#endif
 
 out vec2 TexCoords;
 
@@ -9,7 +21,15 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
+#include "instance_format.glsl"
+
 void main() {
+#if COMPACT_INSTANCES
+    vec3 worldPos = instancePositionScale.xyz
+                  + instancePositionScale.w * quaternionRotate(normalize(instanceRotation), aPos);
+    gl_Position = projection * view * vec4(worldPos, 1.0);
+#else
     gl_Position = projection * view * instanceMatrix * vec4(aPos, 1.0);
+#endif
     TexCoords = aTexCoords;
 }
\ No newline at end of file
@@ -43,10 +43,11 @@ bool firstMouse = true;
 glm::vec3 lightPos(-2.0f, 4.0f, -1.0f);
 
 void prepareDraw() {
-    // Create shader
-    shader = new Shader(vertShaderPath, fragShaderPath);
+    // Create shader, compiled while the rest is loading
+    ShaderBatch shaders;
+    shader = shaders.add(vertShaderPath, fragShaderPath);
     simpleDepthShader =
-        new Shader("../shader/simpleDepthShader.vs", "../shader/empty.fs");
+        shaders.add("../shader/simpleDepthShader.vs", "../shader/empty.fs");
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
@@ -68,6 +69,7 @@ void prepareDraw() {
     floorTexture = loadTexture("../image/wood.png");
 
     // shader
+    shaders.finish();
     shader->use();
     shader->setInt("depthMap", 0);
     shader->setInt("diffuseTexture", 1);
@@ -217,6 +219,8 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
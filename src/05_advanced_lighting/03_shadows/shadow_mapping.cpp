@@ -8,6 +8,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include "../../shader_s.h"
+#include "../../shader_variants.h"
 #include "../../model.h"
 #include "../../camera.h"
 #include "../../common_draw.h"
@@ -22,6 +23,10 @@ int screenHeight = 720;
 
 const GLuint SHADOW_WIDTH = 1024, SHADOW_HEIGHT = 1024;
 
+// one program per PCF kernel size, K switches between them
+ShaderVariants* shadowShaders = nullptr;
+const int pcfKernelSizes[] = {1, 3, 5};
+int pcfKernel = 1;
 Shader* shader = nullptr;
 Shader* simpleDepthShader = nullptr;
 
@@ -43,10 +48,20 @@ bool firstMouse = true;
 glm::vec3 lightPos(-2.0f, 4.0f, -1.0f);
 
 void prepareDraw() {
-    // Create shader
-    shader = new Shader(vertShaderPath, fragShaderPath);
+    // Create shader, compiled while the rest is loading
+    ShaderBatch shaders;
+    shadowShaders = new ShaderVariants(vertShaderPath, fragShaderPath);
+    shadowShaders->setup = [](Shader &variant) {
+        variant.use();
+        variant.setInt("depthMap", 0);
+        variant.setInt("diffuseTexture", 1);
+    };
+    std::vector<ShaderDefines> pcfVariants;
+    for (int size : pcfKernelSizes)
+        pcfVariants.push_back(ShaderDefines().set("PCF_KERNEL_SIZE", size));
+    shadowShaders->prewarm(pcfVariants, shaders);
     simpleDepthShader =
-        new Shader("../shader/simpleDepthShader.vs", "../shader/empty.fs");
+        shaders.add("../shader/simpleDepthShader.vs", "../shader/empty.fs");
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
 
@@ -68,9 +83,7 @@ void prepareDraw() {
     floorTexture = loadTexture("../image/wood.png");
 
     // shader
-    shader->use();
-    shader->setInt("depthMap", 0);
-    shader->setInt("diffuseTexture", 1);
+    shaders.finish();
 
     // Frame buffer
     glGenFramebuffers(1, &depthMapFBO);
@@ -147,6 +160,7 @@ void drawStaff() {
     projection = glm::perspective(glm::radians(camera->zoom), (float) screenWidth / screenHeight, 0.1f, 100.0f);
     glm::mat4 view = camera->getViewMatrix();
 
+    shader = &shadowShaders->get(ShaderDefines().set("PCF_KERNEL_SIZE", pcfKernelSizes[pcfKernel]));
     shader->use();
     // shader->setFloat("near_plane", near_plane);
     // shader->setFloat("far_plane", far_plane);
@@ -217,6 +231,8 @@ int main() {
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
 
         // Clear Screen
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -235,7 +251,7 @@ int main() {
         glfwPollEvents();    
     }
 
-    delete shader;
+    delete shadowShaders;
     glfwTerminate();
     return 0;
 }
@@ -252,6 +268,7 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height) {
 
 bool mouseCap = true;
 bool capKeyPressed = false;
+bool pcfKeyPressed = false;
 
 void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS) {
@@ -279,6 +296,15 @@ void processInput(GLFWwindow *window) {
     if (glfwGetKey(window, GLFW_KEY_Z) == GLFW_RELEASE) {
         capKeyPressed = false;
     }
+    // PCF kernel size
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS && !pcfKeyPressed) {
+        pcfKernel = (pcfKernel + 1) % 3;
+        std::cout << "PCF kernel: " << pcfKernelSizes[pcfKernel] << std::endl;
+        pcfKeyPressed = true;
+    }
+    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_RELEASE) {
+        pcfKeyPressed = false;
+    }
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos) {
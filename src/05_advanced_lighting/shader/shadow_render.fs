@@ -14,6 +14,11 @@ uniform sampler2D shadowMap;
 uniform vec3 lightPos;
 uniform vec3 viewPos;
 
+// PCF 采样核的边长，由 ShaderVariants 注入
+#ifndef PCF_KERNEL_SIZE
+#define PCF_KERNEL_SIZE 3
+#endif
+
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir) {
     // 执行透视除法
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
@@ -27,13 +32,14 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 lightDir) {
     float bias = max(0.05 * (1.0 - dot(fs_in.Normal, lightDir)), 0.005);
     float shadow = 0.0;
     vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
-    for(int x = -1; x <= 1; ++x) {
-        for(int y = -1; y <= 1; ++y) {
+    const int radius = PCF_KERNEL_SIZE / 2;
+    for(int x = -radius; x <= radius; ++x) {
+        for(int y = -radius; y <= radius; ++y) {
             float pcfDepth = texture(shadowMap, projCoords.xy + vec2(x, y) * texelSize).r; 
             shadow += currentDepth - bias > pcfDepth ? 1.0 : 0.0;        
         }
     }
-    shadow /= 9.0;
+    shadow /= float(PCF_KERNEL_SIZE * PCF_KERNEL_SIZE);
 
     if (projCoords.z > 1.0)
         shadow = 0.0;
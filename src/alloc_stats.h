@@ -0,0 +1,44 @@
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+/**
+ * Counts heap allocations of the whole program by replacing the global
+ * operator new/delete. Only include it from a demo's .cpp while measuring
+ * (e.g. under PRINT_ALLOC_STATS) and compare the counters around a frame.
+ */
+std::atomic<unsigned long> heapAllocations(0);
+std::atomic<unsigned long> heapAllocatedBytes(0);
+
+void* operator new(std::size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    heapAllocatedBytes.fetch_add(size, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept {
+    std::free(p);
+}
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef ASTEROID_BELT_H
+#define ASTEROID_BELT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "instance_format.h"
+#include "thread_pool.h"
+
+/**
+ * Instance matrices for a belt of rocks around a planet, as instancing.cpp
+ * lays them out: on a ring of `radius`, displaced by up to `offset` (less
+ * in height), scaled by 0.05 to 0.24 and turned about a fixed axis.
+ * Set `time` to move them on: every rock orbits the planet, the further out
+ * the slower, and spins about the axis at a speed of its own.
+ *
+ * Every random number comes from a counter-based generator keyed by the
+ * seed, the instance and which number of the instance it is, so instance i
+ * is the same whatever thread makes it and in whatever order.
+ * generate() hands out blocks of instances to a ThreadPool and writes each
+ * matrix with four SSE stores, non-temporal when `out` is 16 byte aligned,
+ * which suits a buffer mapped with glMapBufferRange. The same belt comes
+ * as CompactInstances too, rotation as a quaternion:
+ *
+ *     AsteroidBelt belt(amount);
+ *     glBufferData(GL_ARRAY_BUFFER, amount * sizeof(glm::mat4), NULL, GL_STATIC_DRAW);
+ *     glm::mat4 *out = (glm::mat4 *) glMapBufferRange(GL_ARRAY_BUFFER, 0, amount * sizeof(glm::mat4),
+ *                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+ *     belt.generate(out, &threadPool());
+ *     glUnmapBuffer(GL_ARRAY_BUFFER);
+ */
+class AsteroidBelt {
+public:
+    unsigned int amount;
+    float radius;
+    float offset;
+    uint64_t seed;
+    // seconds the belt has moved on, 0 for where it starts
+    float time = 0.0f;
+    // radians a second around the planet at `radius`
+    float orbitSpeed = 0.05f;
+    // the fastest spin, radians a second
+    float spinSpeed = 1.0f;
+
+    // instances per job handed to the pool
+    static const size_t BLOCK = 16384;
+
+    explicit AsteroidBelt(unsigned int amount, float radius = 150.0f, float offset = 25.0f, uint64_t seed = 1)
+        : amount(amount), radius(radius), offset(offset), seed(seed) {
+        // R(a) = cos(a) (I - axis axisT) + sin(a) [axis]x + axis axisT, per column
+        axis = glm::normalize(glm::vec3(0.4f, 0.6f, 0.8f));
+        glm::mat3 outer = glm::outerProduct(axis, axis);
+        glm::mat3 cross(0.0f, axis.z, -axis.y,
+                        -axis.z, 0.0f, axis.x,
+                        axis.y, -axis.x, 0.0f);
+        for (int column = 0; column < 3; column++) {
+            glm::vec3 identity(0.0f);
+            identity[column] = 1.0f;
+            cosTerm[column] = glm::vec4(identity - outer[column], 0.0f);
+            sinTerm[column] = glm::vec4(cross[column], 0.0f);
+            constTerm[column] = glm::vec4(outer[column], 0.0f);
+        }
+    }
+
+    // what one instance is made of
+    struct Placement {
+        glm::vec3 position;
+        float scale;
+        float rotation;
+    };
+
+    Placement placement(size_t i) const {
+        Placement p;
+        // the ring angle goes to sin/cos unconverted, as it always has
+        float angle = (float) i / (float) amount * 360.0f;
+        p.position.x = std::sin(angle) * radius + displacement(i, 0);
+        p.position.y = displacement(i, 1) * 0.4f; // the belt is flatter than it is wide
+        p.position.z = std::cos(angle) * radius + displacement(i, 2);
+        p.scale = (random(i, 3) % 20) / 100.0f + 0.05f;
+        p.rotation = (float) (random(i, 4) % 360);
+        if (time != 0.0f) {
+            // Kepler: the period goes with the distance to the power 1.5
+            float ratio = radius / std::sqrt(p.position.x * p.position.x + p.position.z * p.position.z);
+            float orbit = wrapAngle(orbitSpeed * ratio * std::sqrt(ratio) * time);
+            float s = std::sin(orbit), c = std::cos(orbit);
+            p.position = glm::vec3(c * p.position.x + s * p.position.z, p.position.y,
+                                   c * p.position.z - s * p.position.x);
+            float spin = ((random(i, 5) % 2001) / 1000.0f - 1.0f) * spinSpeed;
+            p.rotation = wrapAngle(p.rotation + spin * time);
+        }
+        return p;
+    }
+
+    // translate, scale and rotate through glm, for checking generate()
+    glm::mat4 matrix(size_t i) const {
+        Placement p = placement(i);
+        glm::mat4 model(1.0f);
+        model = glm::translate(model, p.position);
+        model = glm::scale(model, glm::vec3(p.scale));
+        return glm::rotate(model, p.rotation, glm::vec3(0.4f, 0.6f, 0.8f));
+    }
+
+    // position, scale and the rotation as a quaternion
+    CompactInstance compact(size_t i) const {
+        Placement p = placement(i);
+        CompactInstance instance;
+        for (int component = 0; component < 3; component++)
+            instance.Position[component] = p.position[component];
+        instance.Scale = p.scale;
+        // axis is a unit vector, so this is a unit quaternion already
+        float s = std::sin(0.5f * p.rotation), c = std::cos(0.5f * p.rotation);
+        for (int component = 0; component < 3; component++)
+            instance.Rotation[component] = packSnorm16(axis[component] * s);
+        instance.Rotation[3] = packSnorm16(c);
+        return instance;
+    }
+
+    // instances [first, first + count) into out[0 .. count)
+    void generate(size_t first, size_t count, glm::mat4 *out) const {
+        bool aligned = ((uintptr_t) out & 15) == 0;
+        for (size_t k = 0; k < count; k++) {
+            Placement p = placement(first + k);
+            float s = std::sin(p.rotation) * p.scale, c = std::cos(p.rotation) * p.scale;
+            float *dst = (float *) (out + k);
+#ifdef __SSE2__
+            __m128 sv = _mm_set1_ps(s), cv = _mm_set1_ps(c), scale = _mm_set1_ps(p.scale);
+            __m128 columns[4];
+            for (int column = 0; column < 3; column++) {
+                __m128 v = _mm_mul_ps(cv, _mm_loadu_ps(&cosTerm[column].x));
+                v = _mm_add_ps(v, _mm_mul_ps(sv, _mm_loadu_ps(&sinTerm[column].x)));
+                columns[column] = _mm_add_ps(v, _mm_mul_ps(scale, _mm_loadu_ps(&constTerm[column].x)));
+            }
+            columns[3] = _mm_setr_ps(p.position.x, p.position.y, p.position.z, 1.0f);
+            for (int column = 0; column < 4; column++) {
+                if (aligned)
+                    _mm_stream_ps(dst + 4 * column, columns[column]);
+                else
+                    _mm_storeu_ps(dst + 4 * column, columns[column]);
+            }
+#else
+            (void) aligned;
+            glm::mat4 m;
+            for (int column = 0; column < 3; column++)
+                m[column] = c * cosTerm[column] + s * sinTerm[column] + p.scale * constTerm[column];
+            m[3] = glm::vec4(p.position, 1.0f);
+            std::copy(&m[0][0], &m[0][0] + 16, dst);
+#endif
+        }
+#ifdef __SSE2__
+        if (aligned)
+            _mm_sfence();
+#endif
+    }
+
+    // the same as CompactInstances, 24 bytes a rock instead of 64
+    void generate(size_t first, size_t count, CompactInstance *out) const {
+        for (size_t k = 0; k < count; k++)
+            out[k] = compact(first + k);
+    }
+
+    // all of them, pool = NULL on the calling thread only
+    template <typename Instance>
+    void generate(Instance *out, ThreadPool *pool) const {
+        size_t blocks = (amount + BLOCK - 1) / BLOCK;
+        auto block = [&](size_t b) {
+            size_t first = b * BLOCK;
+            generate(first, std::min((size_t) amount - first, (size_t) BLOCK), out + first);
+        };
+        if (pool) {
+            pool->parallelFor(blocks, block);
+        } else {
+            for (size_t b = 0; b < blocks; b++)
+                block(b);
+        }
+    }
+
+private:
+    glm::vec3 axis;
+    glm::vec4 cosTerm[3], sinTerm[3], constTerm[3];
+
+    // SplitMix64's finaliser over (seed, instance, draw): any number, in any order
+    uint32_t random(size_t instance, unsigned int draw) const {
+        uint64_t z = seed + (instance * 8 + draw + 1) * 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return (uint32_t) ((z ^ (z >> 31)) >> 32);
+    }
+
+    // the same angle in [0, 2 pi), so sin and cos stay accurate however long the belt runs
+    static float wrapAngle(float angle) {
+        return angle - glm::two_pi<float>() * std::floor(angle * glm::one_over_two_pi<float>());
+    }
+
+    // [-offset, offset) in steps of 0.01
+    float displacement(size_t instance, unsigned int draw) const {
+        return (random(instance, draw) % (unsigned int) (2 * offset * 100)) / 100.0f - offset;
+    }
+};
+
+#endif
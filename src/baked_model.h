@@ -0,0 +1,178 @@
+#ifndef BAKED_MODEL_H
+#define BAKED_MODEL_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/stat.h>
+
+#include "mesh.h"
+#include "shader_source.h"
+
+/**
+ * A model baked by src/tool/model_bake.cpp into one file, "<model>.bmesh"
+ * next to the source. It holds what ModelImporter would produce, laid out
+ * so the vertex and index arrays can go from the mapped file straight into
+ * glBufferData:
+ *
+ *     BakedHeader
+ *     BakedMesh[meshCount]
+ *     BakedTexture[textureCount]
+ *     strings, NUL terminated
+ *     vertex and index arrays, each 16 byte aligned
+ *
+ * Offsets are from the start of the file. Textures stay separate files and
+ * are referenced by their path as written in the material.
+ */
+
+const char BAKED_MAGIC[4] = {'B', 'M', 'S', 'H'};
+const uint32_t BAKED_VERSION = 1;
+
+struct BakedHeader {
+    char magic[4];
+    uint32_t version;
+    // sizeof(Vertex) of the baker, the arrays are stored as is
+    uint32_t vertexSize;
+    uint32_t meshCount;
+    uint32_t textureCount;
+    uint32_t stringBytes;
+    uint64_t fileSize;
+};
+
+struct BakedMesh {
+    uint64_t vertexOffset;
+    uint64_t indexOffset;
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    // range in the texture table
+    uint32_t firstTexture;
+    uint32_t textureCount;
+    float boundsMin[3];
+    float boundsMax[3];
+};
+
+struct BakedTexture {
+    // offsets into the string table
+    uint32_t type;
+    uint32_t path;
+};
+
+// -DMODEL_NO_BAKED always goes through Assimp
+#ifdef MODEL_NO_BAKED
+bool modelPreferBaked = false;
+#else
+bool modelPreferBaked = true;
+#endif
+
+// "<path>.bmesh" when it exists and is not older than the model itself
+std::string bakedModelPath(const std::string &path) {
+    if (!modelPreferBaked)
+        return "";
+    std::string baked = path + ".bmesh";
+    struct stat source, target;
+    if (stat(baked.c_str(), &target) != 0)
+        return "";
+    if (stat(path.c_str(), &source) == 0 && source.st_mtime > target.st_mtime)
+        return "";
+    return baked;
+}
+
+/**
+ * A mapped .bmesh file, checked once when opened. Everything returned
+ * points into the mapping and lives as long as this object.
+ */
+class BakedModel {
+public:
+    explicit BakedModel(const std::string &path) : file(path) {
+        valid = check();
+        if (!valid)
+            std::cout << "ERROR::BAKED_MODEL::INVALID_FILE: " << path << std::endl;
+    }
+
+    bool ok() const {
+        return valid;
+    }
+
+    unsigned int meshCount() const {
+        return header()->meshCount;
+    }
+
+    const BakedMesh &mesh(unsigned int i) const {
+        return meshes()[i];
+    }
+
+    const Vertex *vertices(const BakedMesh &mesh) const {
+        return (const Vertex *) (file.data + mesh.vertexOffset);
+    }
+
+    const unsigned int *indices(const BakedMesh &mesh) const {
+        return (const unsigned int *) (file.data + mesh.indexOffset);
+    }
+
+    // the mesh's textures with id 0, to be filled in once loaded
+    vector<Texture> textures(const BakedMesh &mesh) const {
+        vector<Texture> result;
+        for (uint32_t i = 0; i < mesh.textureCount; i++) {
+            const BakedTexture &texture = textureTable()[mesh.firstTexture + i];
+            Texture t;
+            t.id = 0;
+            t.type = string(strings() + texture.type);
+            t.path = aiString(strings() + texture.path);
+            result.push_back(t);
+        }
+        return result;
+    }
+
+private:
+    MappedFile file;
+    bool valid = false;
+
+    const BakedHeader *header() const {
+        return (const BakedHeader *) file.data;
+    }
+
+    const BakedMesh *meshes() const {
+        return (const BakedMesh *) (file.data + sizeof(BakedHeader));
+    }
+
+    const BakedTexture *textureTable() const {
+        return (const BakedTexture *) (meshes() + header()->meshCount);
+    }
+
+    const char *strings() const {
+        return (const char *) (textureTable() + header()->textureCount);
+    }
+
+    // `bytes` at `offset` lie past the tables and within the file, without adding to a possibly huge offset
+    bool inArrays(uint64_t tables, uint64_t offset, uint64_t bytes) const {
+        return offset >= tables && offset <= file.size && bytes <= file.size - offset;
+    }
+
+    bool check() const {
+        if (!file.data || file.size < sizeof(BakedHeader))
+            return false;
+        const BakedHeader *h = header();
+        if (std::memcmp(h->magic, BAKED_MAGIC, 4) != 0 || h->version != BAKED_VERSION ||
+            h->vertexSize != sizeof(Vertex) || h->fileSize != file.size)
+            return false;
+        uint64_t tables = sizeof(BakedHeader) + (uint64_t) h->meshCount * sizeof(BakedMesh) +
+                          (uint64_t) h->textureCount * sizeof(BakedTexture) + h->stringBytes;
+        if (tables > file.size || (h->stringBytes > 0 && strings()[h->stringBytes - 1] != '\0'))
+            return false;
+        for (uint32_t i = 0; i < h->textureCount; i++) {
+            if (textureTable()[i].type >= h->stringBytes || textureTable()[i].path >= h->stringBytes)
+                return false;
+        }
+        for (uint32_t i = 0; i < h->meshCount; i++) {
+            const BakedMesh &m = meshes()[i];
+            if (m.vertexOffset % 16 || m.indexOffset % 16 ||
+                !inArrays(tables, m.vertexOffset, (uint64_t) m.vertexCount * sizeof(Vertex)) ||
+                !inArrays(tables, m.indexOffset, (uint64_t) m.indexCount * sizeof(unsigned int)) ||
+                (uint64_t) m.firstTexture + m.textureCount > h->textureCount)
+                return false;
+        }
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,158 @@
+#ifndef BUFFER_RING_H
+#define BUFFER_RING_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+
+#include "gl_ext.h"
+
+/**
+ * A buffer the CPU rewrites every frame while the GPU still reads what it
+ * wrote the frames before, as for animated instances.
+ *
+ * With GL 4.4 or ARB_buffer_storage the buffer holds `frames` regions and
+ * stays mapped, persistent and coherent, for its whole life. map() hands
+ * out the next region, waiting only if the GPU has not passed the fence
+ * put after the commands that read it `frames` frames ago; with three
+ * regions that practically never happens. Otherwise, or with
+ * -DBUFFER_RING_ORPHAN, the buffer is one region that map() orphans with
+ * glBufferData before mapping it again, and the driver keeps the old
+ * storage alive for the commands still reading it.
+ *
+ * Either way the data is at offset() in buffer(), which changes every frame
+ * on the persistent path, so point attributes and bindings at it after
+ * map().
+ *
+ *     BufferRing ring(amount * sizeof(glm::mat4));
+ *     // every frame
+ *     glm::mat4 *out = (glm::mat4 *) ring.map();
+ *     ... write amount matrices to out ...
+ *     ring.unmap();
+ *     ... draw reading ring.buffer() from ring.offset() ...
+ *     ring.fence();
+ */
+class BufferRing {
+public:
+    // regions are aligned to this, enough for any storage buffer binding
+    static const GLsizeiptr ALIGNMENT = 256;
+    static const int MAX_FRAMES = 4;
+
+    // `frames` regions of `size` bytes, at most MAX_FRAMES
+    explicit BufferRing(GLsizeiptr size, int frames = 3)
+        : size(size), frames(std::min(std::max(frames, 1), (int) MAX_FRAMES)) {
+        stride = (size + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+#ifndef BUFFER_RING_ORPHAN
+        persistentMap = glExt().bufferStorage;
+#endif
+        glGenBuffers(1, &name);
+        glBindBuffer(GL_ARRAY_BUFFER, name);
+        if (persistentMap) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExt().bufferStorageCreate(GL_ARRAY_BUFFER, stride * this->frames, NULL, flags);
+            mapped = (char *) glMapBufferRange(GL_ARRAY_BUFFER, 0, stride * this->frames, flags);
+            // a driver that advertises it and then refuses falls back
+            if (!mapped) {
+                persistentMap = false;
+                glDeleteBuffers(1, &name);
+                glGenBuffers(1, &name);
+                glBindBuffer(GL_ARRAY_BUFFER, name);
+            }
+        }
+        if (!persistentMap) {
+            this->frames = 1;
+            glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    BufferRing(const BufferRing &) = delete;
+    BufferRing &operator=(const BufferRing &) = delete;
+
+    ~BufferRing() {
+        for (int i = 0; i < MAX_FRAMES; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        if (persistentMap) {
+            glBindBuffer(GL_ARRAY_BUFFER, name);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        glDeleteBuffers(1, &name);
+    }
+
+    bool persistent() const {
+        return persistentMap;
+    }
+
+    GLuint buffer() const {
+        return name;
+    }
+
+    // where the region of the last map() starts in buffer()
+    GLintptr offset() const {
+        return current * stride;
+    }
+
+    // the next region, `size` bytes to write, or NULL if it could not be mapped
+    void *map() {
+        auto start = std::chrono::steady_clock::now();
+        void *region = NULL;
+        if (persistentMap) {
+            current = (current + 1) % frames;
+            GLsync &fence = fences[current];
+            if (fence) {
+                // flush once so the fence is sure to be signalled, then wait a millisecond at a time
+                GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+                while (glClientWaitSync(fence, waitFlags, 1000000) == GL_TIMEOUT_EXPIRED)
+                    waitFlags = 0;
+                glDeleteSync(fence);
+                fence = NULL;
+            }
+            region = mapped + offset();
+        } else {
+            glBindBuffer(GL_ARRAY_BUFFER, name);
+            glBufferData(GL_ARRAY_BUFFER, size, NULL, GL_STREAM_DRAW);
+            region = glMapBufferRange(GL_ARRAY_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        std::chrono::duration<double, std::milli> waited = std::chrono::steady_clock::now() - start;
+        lastWait = waited.count();
+        return region;
+    }
+
+    // the region is written; false if its contents were lost (orphaning only)
+    bool unmap() {
+        if (persistentMap)
+            return true; // coherent, the commands issued from now on see the writes
+        glBindBuffer(GL_ARRAY_BUFFER, name);
+        GLboolean intact = glUnmapBuffer(GL_ARRAY_BUFFER);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return intact == GL_TRUE;
+    }
+
+    // after the last command reading the region, so its next map() knows when it is free
+    void fence() {
+        if (persistentMap)
+            fences[current] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    // milliseconds the last map() spent waiting for the GPU, or in the driver orphaning
+    double waitMs() const {
+        return lastWait;
+    }
+
+private:
+    GLuint name = 0;
+    GLsizeiptr size;
+    GLsizeiptr stride;
+    int frames;
+    int current = 0;
+    bool persistentMap = false;
+    char *mapped = NULL;
+    GLsync fences[MAX_FRAMES] = {};
+    double lastWait = 0.0;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <string>
+
+#include "shader_s.h"
+
+// Binding points of the two blocks, the same for every program
+const GLuint FRAME_CAMERA_BINDING = 0;
+const GLuint FRAME_LIGHTS_BINDING = 1;
+// Size of pointLights[] in the Lights block, MAX_POINT_LIGHTS in GLSL
+const int FRAME_MAX_POINT_LIGHTS = 10;
+
+/**
+ * std140 mirrors of the light structs used by the lighting shaders.
+ * A vec3 takes 16 bytes unless a scalar follows it, structs are padded to 16.
+ */
+struct DirLightStd140 {
+    glm::vec3 direction; float _pad0;
+    glm::vec3 ambient;   float _pad1;
+    glm::vec3 diffuse;   float _pad2;
+    glm::vec3 specular;  float _pad3;
+};
+
+struct PointLightStd140 {
+    glm::vec3 position;
+    float constant;
+    float linear;
+    float quadratic; float _pad0[2];
+    glm::vec3 ambient;   float _pad1;
+    glm::vec3 diffuse;   float _pad2;
+    glm::vec3 specular;  float _pad3;
+};
+
+struct SpotLightStd140 {
+    glm::vec3 position;  float _pad0;
+    glm::vec3 direction;
+    float cutOff;
+    float outerCutOff;   float _pad1[3];
+    glm::vec3 ambient;   float _pad2;
+    glm::vec3 diffuse;   float _pad3;
+    glm::vec3 specular;
+    float constant;
+    float linear;
+    float quadratic;     float _pad4[2];
+};
+
+/**
+ * layout (std140) uniform Camera {
+ *     mat4 view;
+ *     mat4 projection;
+ *     vec3 viewPos;
+ * };
+ */
+struct CameraStd140 {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::vec3 viewPos; float _pad0;
+};
+
+/**
+ * layout (std140) uniform Lights {
+ *     int pointCount;
+ *     DirLight dirLight;
+ *     PointLight pointLights[MAX_POINT_LIGHTS];
+ *     SpotLight spotLight;
+ * };
+ */
+struct LightsStd140 {
+    int pointCount; int _pad0[3];
+    DirLightStd140 dirLight;
+    PointLightStd140 pointLights[FRAME_MAX_POINT_LIGHTS];
+    SpotLightStd140 spotLight;
+};
+
+static_assert(offsetof(DirLightStd140, ambient) == 16, "std140 DirLight.ambient");
+static_assert(offsetof(DirLightStd140, specular) == 48, "std140 DirLight.specular");
+static_assert(sizeof(DirLightStd140) == 64, "std140 DirLight size");
+
+static_assert(offsetof(PointLightStd140, constant) == 12, "std140 PointLight.constant");
+static_assert(offsetof(PointLightStd140, quadratic) == 20, "std140 PointLight.quadratic");
+static_assert(offsetof(PointLightStd140, ambient) == 32, "std140 PointLight.ambient");
+static_assert(offsetof(PointLightStd140, specular) == 64, "std140 PointLight.specular");
+static_assert(sizeof(PointLightStd140) == 80, "std140 PointLight array stride");
+
+static_assert(offsetof(SpotLightStd140, direction) == 16, "std140 SpotLight.direction");
+static_assert(offsetof(SpotLightStd140, cutOff) == 28, "std140 SpotLight.cutOff");
+static_assert(offsetof(SpotLightStd140, outerCutOff) == 32, "std140 SpotLight.outerCutOff");
+static_assert(offsetof(SpotLightStd140, ambient) == 48, "std140 SpotLight.ambient");
+static_assert(offsetof(SpotLightStd140, specular) == 80, "std140 SpotLight.specular");
+static_assert(offsetof(SpotLightStd140, constant) == 92, "std140 SpotLight.constant");
+static_assert(offsetof(SpotLightStd140, quadratic) == 100, "std140 SpotLight.quadratic");
+static_assert(sizeof(SpotLightStd140) == 112, "std140 SpotLight size");
+
+static_assert(offsetof(CameraStd140, projection) == 64, "std140 Camera.projection");
+static_assert(offsetof(CameraStd140, viewPos) == 128, "std140 Camera.viewPos");
+
+static_assert(offsetof(LightsStd140, dirLight) == 16, "std140 Lights.dirLight");
+static_assert(offsetof(LightsStd140, pointLights) == 80, "std140 Lights.pointLights");
+static_assert(offsetof(LightsStd140, spotLight) == 80 + 80 * FRAME_MAX_POINT_LIGHTS, "std140 Lights.spotLight");
+
+/**
+ * GLSL side of the structs above, available to every shader as
+ * `#include "frame_uniforms.glsl"` so the layout is only written down here.
+ */
+const char* FRAME_UNIFORMS_GLSL = R"(
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight {
+    vec3 position;
+
+    float constant;
+    float linear;
+    float quadratic;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight {
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+layout (std140) uniform Camera {
+    mat4 view;
+    mat4 projection;
+    vec3 viewPos;
+};
+
+layout (std140) uniform Lights {
+    int pointCount;
+    DirLight dirLight;
+    PointLight pointLights[MAX_POINT_LIGHTS];
+    SpotLight spotLight;
+};
+)";
+
+const bool frameUniformsGlslRegistered = (shaderSources().addBuiltin("frame_uniforms.glsl",
+    "#define MAX_POINT_LIGHTS " + std::to_string(FRAME_MAX_POINT_LIGHTS) + "\n" + FRAME_UNIFORMS_GLSL), true);
+
+/**
+ * Per-frame camera and light data shared by all programs through one
+ * uniform buffer holding both blocks. Fill `camera` / `lights`, call
+ * upload() once per frame, and attach() every program after it is built.
+ */
+class FrameUniforms {
+public:
+    CameraStd140 camera;
+    LightsStd140 lights;
+
+    FrameUniforms() : camera(), lights() {
+        // the lights block starts at the next offset the driver accepts
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        lightsOffset = (sizeof(CameraStd140) + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &UBO);
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferData(GL_UNIFORM_BUFFER, lightsOffset + sizeof(LightsStd140), NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_CAMERA_BINDING, UBO, 0, sizeof(CameraStd140));
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_LIGHTS_BINDING, UBO, lightsOffset, sizeof(LightsStd140));
+    }
+
+    ~FrameUniforms() {
+        glDeleteBuffers(1, &UBO);
+    }
+
+    FrameUniforms(const FrameUniforms &) = delete;
+    FrameUniforms &operator=(const FrameUniforms &) = delete;
+
+    // GLSL 330 has no layout(binding), so wire the blocks up after link
+    void attach(const Shader &shader) const {
+        GLuint index = glGetUniformBlockIndex(shader.ID, "Camera");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, index, FRAME_CAMERA_BINDING);
+        index = glGetUniformBlockIndex(shader.ID, "Lights");
+        if (index != GL_INVALID_INDEX)
+            glUniformBlockBinding(shader.ID, index, FRAME_LIGHTS_BINDING);
+    }
+
+    void setCamera(const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &viewPos) {
+        camera.view = view;
+        camera.projection = projection;
+        camera.viewPos = viewPos;
+    }
+
+    void setDirLight(const glm::vec3 &direction, const glm::vec3 &ambient,
+                     const glm::vec3 &diffuse, const glm::vec3 &specular) {
+        DirLightStd140 &light = lights.dirLight;
+        light.direction = direction;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+    }
+
+    void setPointLight(int i, const glm::vec3 &position, const glm::vec3 &ambient,
+                       const glm::vec3 &diffuse, const glm::vec3 &specular,
+                       float constant, float linear, float quadratic) {
+        PointLightStd140 &light = lights.pointLights[i];
+        light.position = position;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+    }
+
+    void setSpotLight(const glm::vec3 &position, const glm::vec3 &direction,
+                      float cutOff, float outerCutOff, const glm::vec3 &ambient,
+                      const glm::vec3 &diffuse, const glm::vec3 &specular,
+                      float constant, float linear, float quadratic) {
+        SpotLightStd140 &light = lights.spotLight;
+        light.position = position;
+        light.direction = direction;
+        light.cutOff = cutOff;
+        light.outerCutOff = outerCutOff;
+        light.ambient = ambient;
+        light.diffuse = diffuse;
+        light.specular = specular;
+        light.constant = constant;
+        light.linear = linear;
+        light.quadratic = quadratic;
+    }
+
+    // one buffer update per frame, whatever the number of programs
+    void upload() const {
+        glBindBuffer(GL_UNIFORM_BUFFER, UBO);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraStd140), &camera);
+        glBufferSubData(GL_UNIFORM_BUFFER, lightsOffset, sizeof(LightsStd140), &lights);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+
+private:
+    GLuint UBO;
+    GLintptr lightsOffset;
+};
+
+#endif
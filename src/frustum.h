@@ -0,0 +1,192 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#ifdef __AVX__
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/**
+ * The six planes of a clip matrix and a test of axis aligned boxes against
+ * them.
+ *
+ * Built from projection * view the planes are in world space; built from
+ * projection * view * model they are in the model's space, so a model's
+ * mesh bounds can be tested as they are. A box is culled when it lies
+ * entirely behind one plane. Boxes straddling two planes outside a corner
+ * are kept, which only costs a draw.
+ *
+ *     Frustum frustum(projection * view * modelMat);
+ *     CullBoxes boxes;
+ *     boxes.add(mesh.boundsMin, mesh.boundsMax);
+ *     size_t visible = boxes.cull(frustum, flags);   // flags[i] = 0 or 1
+ */
+struct Frustum {
+    // (normal, distance), inside where dot(normal, p) + distance >= 0
+    glm::vec4 planes[6];
+
+    Frustum() = default;
+
+    // Gribb and Hartmann: each plane is the fourth row plus or minus one of the others
+    explicit Frustum(const glm::mat4 &clip) {
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++)
+            rows[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+        for (int i = 0; i < 3; i++) {
+            planes[2 * i] = rows[3] + rows[i];
+            planes[2 * i + 1] = rows[3] - rows[i];
+        }
+        for (glm::vec4 &plane : planes) {
+            float length = glm::length(glm::vec3(plane));
+            if (length > 0.0f)
+                plane /= length;
+        }
+    }
+
+    bool intersects(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) const {
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+        // summed in the same order as CullBoxes::cull()
+        for (const glm::vec4 &plane : planes) {
+            float d = plane.x * center.x + plane.w;
+            d += plane.y * center.y;
+            d += plane.z * center.z;
+            d += std::abs(plane.x) * extent.x;
+            d += std::abs(plane.y) * extent.y;
+            d += std::abs(plane.z) * extent.z;
+            if (d < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+/**
+ * Boxes kept as centers and half extents, one array per axis, so that
+ * cull() tests 8 (AVX) or 4 (SSE2) of them per instruction.
+ */
+class CullBoxes {
+public:
+    size_t size() const {
+        return count;
+    }
+
+    void clear() {
+        count = 0;
+        for (std::vector<float> &lane : lanes)
+            lane.clear();
+    }
+
+    void reserve(size_t boxes) {
+        for (std::vector<float> &lane : lanes)
+            lane.reserve(padded(boxes));
+    }
+
+    void add(const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+        glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+        glm::vec3 extent = (boundsMax - boundsMin) * 0.5f;
+        // the lanes stay a whole number of vectors long, the padding is never reported
+        if (count == lanes[0].size())
+            for (std::vector<float> &lane : lanes)
+                lane.resize(padded(count + 1), 0.0f);
+        for (int axis = 0; axis < 3; axis++) {
+            lanes[axis][count] = center[axis];
+            lanes[3 + axis][count] = extent[axis];
+        }
+        count++;
+    }
+
+    // visible[i] = 1 for every box intersecting the frustum, 0 for the rest;
+    // returns how many are visible
+    size_t cull(const Frustum &frustum, unsigned char *visible) const {
+        size_t i = 0, result = 0;
+        const float *cx = lanes[0].data(), *cy = lanes[1].data(), *cz = lanes[2].data();
+        const float *ex = lanes[3].data(), *ey = lanes[4].data(), *ez = lanes[5].data();
+#ifdef __AVX__
+        __m256 zero = _mm256_setzero_ps();
+        __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+        __m256 planes[6][4], absNormals[6][3];
+        for (int p = 0; p < 6; p++)
+            for (int k = 0; k < 4; k++) {
+                planes[p][k] = _mm256_set1_ps(frustum.planes[p][k]);
+                if (k < 3)
+                    absNormals[p][k] = _mm256_and_ps(planes[p][k], absMask);
+            }
+        for (; i < count; i += 8) {
+            __m256 x = _mm256_loadu_ps(cx + i), y = _mm256_loadu_ps(cy + i), z = _mm256_loadu_ps(cz + i);
+            __m256 rx = _mm256_loadu_ps(ex + i), ry = _mm256_loadu_ps(ey + i), rz = _mm256_loadu_ps(ez + i);
+            __m256 outside = zero;
+            for (int p = 0; p < 6; p++) {
+                __m256 d = _mm256_add_ps(_mm256_mul_ps(planes[p][0], x), planes[p][3]);
+                d = _mm256_add_ps(d, _mm256_mul_ps(planes[p][1], y));
+                d = _mm256_add_ps(d, _mm256_mul_ps(planes[p][2], z));
+                d = _mm256_add_ps(d, _mm256_mul_ps(absNormals[p][0], rx));
+                d = _mm256_add_ps(d, _mm256_mul_ps(absNormals[p][1], ry));
+                d = _mm256_add_ps(d, _mm256_mul_ps(absNormals[p][2], rz));
+                outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+            }
+            result += store(~_mm256_movemask_ps(outside) & 0xFF, i, 8, visible);
+        }
+#elif defined(__SSE2__)
+        __m128 zero = _mm_setzero_ps();
+        __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+        __m128 planes[6][4], absNormals[6][3];
+        for (int p = 0; p < 6; p++)
+            for (int k = 0; k < 4; k++) {
+                planes[p][k] = _mm_set1_ps(frustum.planes[p][k]);
+                if (k < 3)
+                    absNormals[p][k] = _mm_and_ps(planes[p][k], absMask);
+            }
+        for (; i < count; i += 4) {
+            __m128 x = _mm_loadu_ps(cx + i), y = _mm_loadu_ps(cy + i), z = _mm_loadu_ps(cz + i);
+            __m128 rx = _mm_loadu_ps(ex + i), ry = _mm_loadu_ps(ey + i), rz = _mm_loadu_ps(ez + i);
+            __m128 outside = zero;
+            for (int p = 0; p < 6; p++) {
+                __m128 d = _mm_add_ps(_mm_mul_ps(planes[p][0], x), planes[p][3]);
+                d = _mm_add_ps(d, _mm_mul_ps(planes[p][1], y));
+                d = _mm_add_ps(d, _mm_mul_ps(planes[p][2], z));
+                d = _mm_add_ps(d, _mm_mul_ps(absNormals[p][0], rx));
+                d = _mm_add_ps(d, _mm_mul_ps(absNormals[p][1], ry));
+                d = _mm_add_ps(d, _mm_mul_ps(absNormals[p][2], rz));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+            }
+            result += store(~_mm_movemask_ps(outside) & 0xF, i, 4, visible);
+        }
+#endif
+        for (; i < count; i++) {
+            glm::vec3 center(cx[i], cy[i], cz[i]), extent(ex[i], ey[i], ez[i]);
+            visible[i] = frustum.intersects(center - extent, center + extent);
+            result += visible[i];
+        }
+        return result;
+    }
+
+private:
+    static const size_t WIDTH = 8;
+
+    // center x, y, z, then extent x, y, z
+    std::vector<float> lanes[6];
+    size_t count = 0;
+
+    static size_t padded(size_t boxes) {
+        return (boxes + WIDTH - 1) / WIDTH * WIDTH;
+    }
+
+    // one bit per box of a vector, the padding past count dropped
+    size_t store(int mask, size_t first, size_t width, unsigned char *visible) const {
+        size_t n = std::min(width, count - first), result = 0;
+        for (size_t k = 0; k < n; k++) {
+            visible[first + k] = (mask >> k) & 1;
+            result += visible[first + k];
+        }
+        return result;
+    }
+};
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef GEOMETRY_ARENA_H
+#define GEOMETRY_ARENA_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "vertex_format.h"
+
+/**
+ * Vertex and index buffers shared by many meshes.
+ *
+ * Storage comes in blocks of one vertex format: a vertex buffer, an index
+ * buffer and the one VAO reading them. A mesh gets a range of both and is
+ * drawn with glDrawElementsBaseVertex, so consecutive meshes of a block
+ * need no VAO or buffer switch in between (Model::draw binds each VAO
+ * once). A mesh larger than a block gets a block of its own.
+ *
+ * Ranges are handed out front to back; a block is reused once every range
+ * in it is released, which is how whole models come and go here. The arena
+ * must outlive the meshes in it.
+ *
+ *     GeometryArena::Range range = geometryArena().allocate(VERTEX_FLOAT, vertexCount, indexBytes);
+ *     glBindBuffer(GL_COPY_WRITE_BUFFER, range.vbo);
+ *     glBufferSubData(GL_COPY_WRITE_BUFFER, range.vertexOffset, vertexBytes, vertices);
+ *     ...
+ *     glBindVertexArray(range.vao);
+ *     glDrawElementsBaseVertex(GL_TRIANGLES, count, type, (void *) range.indexOffset, range.baseVertex);
+ *     geometryArena().release(range);
+ */
+class GeometryArena {
+public:
+    // where one mesh lives; offsets in bytes
+    struct Range {
+        GLuint vao = 0, vbo = 0, ebo = 0;
+        size_t block = 0;
+        GLint baseVertex = 0;
+        size_t vertexOffset = 0;
+        size_t indexOffset = 0;
+    };
+
+    // bytes of each vertex and index buffer
+    explicit GeometryArena(size_t blockBytes = 16 << 20) : blockBytes(blockBytes) {
+    }
+
+    GeometryArena(const GeometryArena &) = delete;
+    GeometryArena &operator=(const GeometryArena &) = delete;
+
+    ~GeometryArena() {
+        for (Block &block : blocks) {
+            glDeleteVertexArrays(1, &block.vao);
+            glDeleteBuffers(1, &block.vbo);
+            glDeleteBuffers(1, &block.ebo);
+        }
+    }
+
+    // storage for vertexCount vertices and indexBytes of indices, left unfilled
+    Range allocate(VertexFormat format, unsigned int vertexCount, size_t indexBytes) {
+        size_t stride = vertexSize(format);
+        size_t vertexBytes = (size_t) vertexCount * stride;
+        // mixed 16 and 32 bit indices stay aligned to their size
+        indexBytes = (indexBytes + 3) & ~(size_t) 3;
+        size_t b = 0;
+        while (b < blocks.size() && !fits(blocks[b], format, vertexBytes, indexBytes))
+            b++;
+        if (b == blocks.size())
+            addBlock(format, std::max(vertexBytes, blockBytes), std::max(indexBytes, blockBytes));
+
+        Block &block = blocks[b];
+        Range range;
+        range.vao = block.vao;
+        range.vbo = block.vbo;
+        range.ebo = block.ebo;
+        range.block = b;
+        range.baseVertex = block.vertexUsed / stride;
+        range.vertexOffset = block.vertexUsed;
+        range.indexOffset = block.indexUsed;
+        block.vertexUsed += vertexBytes;
+        block.indexUsed += indexBytes;
+        block.ranges++;
+        return range;
+    }
+
+    void release(const Range &range) {
+        Block &block = blocks[range.block];
+        if (--block.ranges == 0)
+            block.vertexUsed = block.indexUsed = 0;
+    }
+
+    size_t blockCount() const {
+        return blocks.size();
+    }
+
+private:
+    struct Block {
+        VertexFormat format;
+        GLuint vao, vbo, ebo;
+        size_t vertexCapacity, vertexUsed;
+        size_t indexCapacity, indexUsed;
+        size_t ranges;
+    };
+
+    size_t blockBytes;
+    std::vector<Block> blocks;
+
+    static bool fits(const Block &block, VertexFormat format, size_t vertexBytes, size_t indexBytes) {
+        return block.format == format && block.vertexUsed + vertexBytes <= block.vertexCapacity &&
+               block.indexUsed + indexBytes <= block.indexCapacity;
+    }
+
+    void addBlock(VertexFormat format, size_t vertexCapacity, size_t indexCapacity) {
+        Block block = {format, 0, 0, 0, vertexCapacity, 0, indexCapacity, 0, 0};
+        glGenVertexArrays(1, &block.vao);
+        glGenBuffers(1, &block.vbo);
+        glGenBuffers(1, &block.ebo);
+        glBindVertexArray(block.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, block.vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexCapacity, NULL, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, block.ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCapacity, NULL, GL_STATIC_DRAW);
+        setupVertexAttributes(format);
+        glBindVertexArray(0);
+        blocks.push_back(block);
+    }
+};
+
+// the arena models use unless given their own; never destroyed, it would
+// outlive the GL context anyway
+GeometryArena &geometryArena() {
+    static GeometryArena *arena = new GeometryArena();
+    return *arena;
+}
+
+#endif
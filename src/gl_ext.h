@@ -0,0 +1,157 @@
+#ifndef GL_EXT_H
+#define GL_EXT_H
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include <cstring>
+
+/**
+ * Optional entry points beyond the GL 3.3 core profile glad was generated
+ * for. They are loaded through GLFW the first time glExt() is called (a
+ * context must be current), and every pointer stays NULL when the driver
+ * supports neither the core version nor the extension.
+ */
+
+// GL 4.1 / ARB_get_program_binary
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+// KHR_parallel_shader_compile / ARB_parallel_shader_compile
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// GL 4.0 / ARB_draw_indirect
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+// GL 4.3 / ARB_compute_shader, ARB_shader_storage_buffer_object
+#ifndef GL_COMPUTE_SHADER
+#define GL_COMPUTE_SHADER 0x91B9
+#define GL_SHADER_STORAGE_BUFFER 0x90D2
+#define GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT 0x00000001
+#define GL_COMMAND_BARRIER_BIT 0x00000040
+#define GL_BUFFER_UPDATE_BARRIER_BIT 0x00000200
+#define GL_SHADER_STORAGE_BARRIER_BIT 0x00002000
+#endif
+
+// GL 4.4 / ARB_buffer_storage
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#define GL_MAP_COHERENT_BIT 0x0080
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#define GL_CLIENT_STORAGE_BIT 0x0200
+#endif
+
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYEXTPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYEXTPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIEXTPROC)(GLuint program, GLenum pname, GLint value);
+typedef void (APIENTRYP PFNGLMAXSHADERCOMPILERTHREADSEXTPROC)(GLuint count);
+typedef void (APIENTRYP PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC)(GLenum mode, GLenum type, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void (APIENTRYP PFNGLDRAWELEMENTSINDIRECTEXTPROC)(GLenum mode, GLenum type, const void *indirect);
+typedef void (APIENTRYP PFNGLDISPATCHCOMPUTEEXTPROC)(GLuint x, GLuint y, GLuint z);
+typedef void (APIENTRYP PFNGLMEMORYBARRIEREXTPROC)(GLbitfield barriers);
+typedef void (APIENTRYP PFNGLBUFFERSTORAGEEXTPROC)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+
+struct GLExtensions {
+    bool loaded = false;
+    int major = 3, minor = 3;
+
+    // program binaries
+    bool programBinary = false;
+    PFNGLGETPROGRAMBINARYEXTPROC getProgramBinary = NULL;
+    PFNGLPROGRAMBINARYEXTPROC programBinaryLoad = NULL;
+    PFNGLPROGRAMPARAMETERIEXTPROC programParameteri = NULL;
+
+    // compiles and links run on driver threads, GL_COMPLETION_STATUS_KHR polls them
+    bool parallelShaderCompile = false;
+    PFNGLMAXSHADERCOMPILERTHREADSEXTPROC maxShaderCompilerThreads = NULL;
+
+    // many draws from one GL_DRAW_INDIRECT_BUFFER in one call
+    bool multiDrawIndirect = false;
+    PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC multiDrawElementsIndirect = NULL;
+
+    // compute shaders writing storage buffers that feed an indirect draw
+    bool computeCulling = false;
+    PFNGLDISPATCHCOMPUTEEXTPROC dispatchCompute = NULL;
+    PFNGLMEMORYBARRIEREXTPROC memoryBarrier = NULL;
+    PFNGLDRAWELEMENTSINDIRECTEXTPROC drawElementsIndirect = NULL;
+
+    // immutable buffers that can stay mapped while the GPU reads them
+    bool bufferStorage = false;
+    PFNGLBUFFERSTORAGEEXTPROC bufferStorageCreate = NULL;
+
+    bool hasVersion(int wantMajor, int wantMinor) const {
+        return major > wantMajor || (major == wantMajor && minor >= wantMinor);
+    }
+
+    bool hasExtension(const char *name) const {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; i++) {
+            const char *ext = (const char *) glGetStringi(GL_EXTENSIONS, i);
+            if (ext && std::strcmp(ext, name) == 0)
+                return true;
+        }
+        return false;
+    }
+
+    void load() {
+        loaded = true;
+        glGetIntegerv(GL_MAJOR_VERSION, &major);
+        glGetIntegerv(GL_MINOR_VERSION, &minor);
+
+        if (hasVersion(4, 1) || hasExtension("GL_ARB_get_program_binary")) {
+            getProgramBinary = (PFNGLGETPROGRAMBINARYEXTPROC) glfwGetProcAddress("glGetProgramBinary");
+            programBinaryLoad = (PFNGLPROGRAMBINARYEXTPROC) glfwGetProcAddress("glProgramBinary");
+            programParameteri = (PFNGLPROGRAMPARAMETERIEXTPROC) glfwGetProcAddress("glProgramParameteri");
+            GLint formats = 0;
+            glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+            programBinary = getProgramBinary && programBinaryLoad && programParameteri && formats > 0;
+        }
+
+        if (hasExtension("GL_KHR_parallel_shader_compile")) {
+            maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSEXTPROC) glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+        } else if (hasExtension("GL_ARB_parallel_shader_compile")) {
+            maxShaderCompilerThreads = (PFNGLMAXSHADERCOMPILERTHREADSEXTPROC) glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+        }
+        if (maxShaderCompilerThreads) {
+            parallelShaderCompile = true;
+            // let the driver pick as many threads as it likes
+            maxShaderCompilerThreads(0xFFFFFFFFu);
+        }
+
+        if (hasVersion(4, 3) || (hasExtension("GL_ARB_multi_draw_indirect") && hasExtension("GL_ARB_draw_indirect"))) {
+            multiDrawElementsIndirect = (PFNGLMULTIDRAWELEMENTSINDIRECTEXTPROC) glfwGetProcAddress("glMultiDrawElementsIndirect");
+            multiDrawIndirect = multiDrawElementsIndirect != NULL;
+        }
+
+        if (hasVersion(4, 3) || (hasExtension("GL_ARB_compute_shader") &&
+                                 hasExtension("GL_ARB_shader_storage_buffer_object") &&
+                                 hasExtension("GL_ARB_draw_indirect"))) {
+            dispatchCompute = (PFNGLDISPATCHCOMPUTEEXTPROC) glfwGetProcAddress("glDispatchCompute");
+            memoryBarrier = (PFNGLMEMORYBARRIEREXTPROC) glfwGetProcAddress("glMemoryBarrier");
+            drawElementsIndirect = (PFNGLDRAWELEMENTSINDIRECTEXTPROC) glfwGetProcAddress("glDrawElementsIndirect");
+            computeCulling = dispatchCompute && memoryBarrier && drawElementsIndirect;
+        }
+
+        if (hasVersion(4, 4) || hasExtension("GL_ARB_buffer_storage")) {
+            bufferStorageCreate = (PFNGLBUFFERSTORAGEEXTPROC) glfwGetProcAddress("glBufferStorage");
+            bufferStorage = bufferStorageCreate != NULL;
+        }
+    }
+};
+
+GLExtensions &glExt() {
+    static GLExtensions ext;
+    if (!ext.loaded)
+        ext.load();
+    return ext;
+}
+
+#endif
@@ -0,0 +1,189 @@
+#ifndef INDIRECT_DRAW_H
+#define INDIRECT_DRAW_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "gl_ext.h"
+#include "mesh.h"
+#include "shader_s.h"
+
+// the layout glMultiDrawElementsIndirect reads
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+/**
+ * A model's meshes as draw commands, issued a run at a time.
+ *
+ * Consecutive meshes that share a VAO (an arena block, see
+ * geometry_arena.h), an index type, a program and the same textures form a
+ * run. Each run is one glMultiDrawElementsIndirect call over its commands
+ * in a GL_DRAW_INDIRECT_BUFFER. Without GL 4.3 / ARB_multi_draw_indirect
+ * (or with -DMODEL_INDIRECT_FALLBACK) the same commands are handed to
+ * glMultiDrawElementsBaseVertex from client memory, core since 3.2, which
+ * is still one call per run. Draw order is kept as it is, blended models
+ * depend on it. Packed meshes carry their bounds in uniforms, so each is a
+ * run of its own.
+ *
+ *     IndirectDrawList list;
+ *     list.build(model.meshes);   // again whenever meshes were added
+ *     list.draw(model.meshes, withSpecular, withoutSpecular);
+ */
+class IndirectDrawList {
+public:
+    IndirectDrawList() = default;
+    IndirectDrawList(const IndirectDrawList &) = delete;
+    IndirectDrawList &operator=(const IndirectDrawList &) = delete;
+
+    ~IndirectDrawList() {
+        if (buffer)
+            glDeleteBuffers(1, &buffer);
+    }
+
+    size_t meshCount() const {
+        return builtFor;
+    }
+
+    size_t runCount() const {
+        return runs.size();
+    }
+
+    void build(const std::vector<Mesh> &meshes) {
+        commands.clear();
+        runs.clear();
+        counts.clear();
+        offsets.clear();
+        baseVertices.clear();
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const Mesh &mesh = meshes[i];
+            if (runs.empty() || !sameState(meshes[runs.back().mesh], mesh)) {
+                Run run = {i, mesh.vertexArray(), mesh.indexType, mesh.hasTexture("texture_specular"),
+                           commands.size(), 0, 0};
+                runs.push_back(run);
+            }
+            DrawElementsIndirectCommand command = {mesh.indexCount, 1, mesh.firstIndex(), mesh.baseVertex(), 0};
+            commands.push_back(command);
+            runs.back().commandCount++;
+            runs.back().visibleCommands++;
+            counts.push_back(mesh.indexCount);
+            offsets.push_back((const void *) ((size_t) mesh.firstIndex() * mesh.indexStride()));
+            baseVertices.push_back(mesh.baseVertex());
+        }
+        builtFor = meshes.size();
+
+#ifndef MODEL_INDIRECT_FALLBACK
+        indirect = glExt().multiDrawIndirect;
+#endif
+        if (indirect && !commands.empty()) {
+            if (!buffer)
+                glGenBuffers(1, &buffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                         commands.data(), GL_STATIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+    }
+
+    // a mesh with a specular map uses withSpecular, the others withoutSpecular;
+    // visible[i] = 0 (see Frustum) leaves mesh i out, NULL draws them all
+    void draw(const std::vector<Mesh> &meshes, const Shader &withSpecular, const Shader &withoutSpecular,
+              const unsigned char *visible = NULL) {
+        if (runs.empty())
+            return;
+        if (indirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+        setVisible(visible);
+        const Shader *current = NULL;
+        GLuint boundVertexArray = 0;
+        for (const Run &run : runs) {
+            if (run.visibleCommands == 0)
+                continue;
+            const Shader &shader = run.specular ? withSpecular : withoutSpecular;
+            if (&shader != current) {
+                glUseProgram(shader.ID);
+                current = &shader;
+            }
+            meshes[run.mesh].bindTextures(shader);
+            if (run.vertexArray != boundVertexArray) {
+                glBindVertexArray(run.vertexArray);
+                boundVertexArray = run.vertexArray;
+                meshDrawStats.vertexArrayBinds++;
+            }
+            if (indirect) {
+                glExt().multiDrawElementsIndirect(GL_TRIANGLES, run.indexType,
+                                                  (const void *) (run.firstCommand * sizeof(DrawElementsIndirectCommand)),
+                                                  run.commandCount, 0);
+            } else {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, &counts[run.firstCommand], run.indexType,
+                                              (const void *const *) &offsets[run.firstCommand], run.commandCount,
+                                              (GLint *) &baseVertices[run.firstCommand]);
+            }
+            meshDrawStats.drawCalls++;
+        }
+        glBindVertexArray(0);
+        meshDrawStats.vertexArrayBinds++;
+        if (indirect)
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+private:
+    struct Run {
+        size_t mesh;    // the first, its textures stand for the run
+        GLuint vertexArray;
+        GLenum indexType;
+        bool specular;
+        size_t firstCommand;
+        GLsizei commandCount;
+        GLsizei visibleCommands;
+    };
+
+    std::vector<DrawElementsIndirectCommand> commands;
+    std::vector<Run> runs;
+    // the same commands for glMultiDrawElementsBaseVertex
+    std::vector<GLsizei> counts;
+    std::vector<const void *> offsets;
+    std::vector<GLint> baseVertices;
+    GLuint buffer = 0;
+    size_t builtFor = 0;
+    bool indirect = false;
+
+    // a culled command keeps its place with no instances (no indices for the
+    // fallback); the buffer is only written when that changed since last frame
+    void setVisible(const unsigned char *visible) {
+        bool changed = false;
+        for (Run &run : runs) {
+            run.visibleCommands = 0;
+            for (size_t i = run.firstCommand; i < run.firstCommand + run.commandCount; i++) {
+                GLuint instances = !visible || visible[i] ? 1 : 0;
+                run.visibleCommands += instances;
+                if (commands[i].instanceCount != instances) {
+                    commands[i].instanceCount = instances;
+                    counts[i] = instances ? commands[i].count : 0;
+                    changed = true;
+                }
+            }
+        }
+        if (changed && indirect)
+            glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand),
+                            commands.data());
+    }
+
+    static bool sameState(const Mesh &a, const Mesh &b) {
+        if (a.vertexArray() != b.vertexArray() || a.indexType != b.indexType ||
+            a.vertexFormat == VERTEX_PACKED || b.vertexFormat == VERTEX_PACKED ||
+            a.textures.size() != b.textures.size())
+            return false;
+        for (size_t i = 0; i < a.textures.size(); i++)
+            if (a.textures[i].id != b.textures[i].id || a.textures[i].type != b.textures[i].type)
+                return false;
+        return true;
+    }
+};
+
+#endif
@@ -0,0 +1,511 @@
+#ifndef INSTANCE_CULL_H
+#define INSTANCE_CULL_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "frustum.h"
+#include "gl_ext.h"
+#include "indirect_draw.h"
+#include "instance_format.h"
+#include "mesh.h"
+#include "shader_s.h"
+
+/**
+ * Frustum culling of instances on the GPU, for fields of instanced meshes
+ * too large to test on the CPU every frame.
+ *
+ * Every instance is a mat4 or a CompactInstance (see instance_format.h) in
+ * a buffer the caller fills. cull() tests the meshes' bounding sphere,
+ * moved by each instance, against the frustum and packs the instances that
+ * pass into visibleBuffer(); draw() then draws the meshes once per visible
+ * instance, its attributes from location 3 on like instancing.vs expects.
+ *
+ * With GL 4.3 (or the compute shader, storage buffer and draw indirect
+ * extensions) a compute shader does the packing and counts the survivors
+ * straight into a DrawElementsIndirectCommand, so the CPU never waits.
+ * Otherwise, or with -DINSTANCE_CULL_FEEDBACK, a vertex and geometry shader
+ * pass writes them with transform feedback into one of three buffers in
+ * turn, each with its own primitives written query. draw() draws the
+ * newest buffer whose count has come back, normally the previous frame's,
+ * so the culling lags a frame behind but the CPU does not wait. It waits
+ * only for the first cull, or when the GPU falls more than two culls
+ * behind.
+ *
+ * The instance attributes are set on the meshes' VAOs, so the meshes need
+ * an arena (or VAOs) of their own. Instances rewritten every frame can sit
+ * anywhere in the buffer, say a BufferRing region; pass cull() the byte
+ * offset they start at.
+ *
+ *     InstanceCuller *culler = new InstanceCuller(shaders, instanceVBO, amount, rock->meshes);
+ *     shaders.finish();
+ *     // every frame
+ *     culler->cull(projection * view);
+ *     ... draw something else ...
+ *     instanceShader->use();
+ *     culler->draw();
+ */
+
+const std::string INSTANCE_CULL_GLSL = R"(
+#ifndef COMPACT_INSTANCES
+#define COMPACT_INSTANCES 0
+#endif
+
+#include "instance_format.glsl"
+
+// the meshes' bounding sphere, xyz center and w radius, in model space
+uniform vec4 bounds;
+// (normal, distance), inside where dot(normal, p) + distance >= 0
+uniform vec4 planes[6];
+
+bool sphereVisible(vec3 center, float radius) {
+    for (int i = 0; i < 6; i++)
+        if (dot(planes[i].xyz, center) + planes[i].w < -radius)
+            return false;
+    return true;
+}
+
+bool instanceVisible(mat4 instance) {
+    vec3 center = vec3(instance * vec4(bounds.xyz, 1.0));
+    float scale = max(length(instance[0].xyz), max(length(instance[1].xyz), length(instance[2].xyz)));
+    return sphereVisible(center, bounds.w * scale);
+}
+
+// a CompactInstance, the rotation as stored
+bool instanceVisible(vec4 positionScale, uvec2 rotation) {
+    vec4 q = normalize(vec4(unpackSnorm16x2(rotation.x), unpackSnorm16x2(rotation.y)));
+    vec3 center = positionScale.xyz + positionScale.w * quaternionRotate(q, bounds.xyz);
+    return sphereVisible(center, bounds.w * positionScale.w);
+}
+)";
+
+// transform feedback: one point per instance, the geometry shader drops the
+// hidden ones; compact instances are read and written as they are stored
+const std::string INSTANCE_CULL_VS = R"(#version 330 core
+#include "instance_cull.glsl"
+
+#if COMPACT_INSTANCES
+layout (location = 0) in vec4 instancePositionScale;
+layout (location = 1) in uvec2 instanceRotation;
+
+out vec4 vertexPositionScale;
+flat out uvec2 vertexRotation;
+#else
+layout (location = 0) in mat4 instanceMatrix;
+
+out mat4 vertexMatrix;
+#endif
+out float vertexVisible;
+
+void main() {
+#if COMPACT_INSTANCES
+    vertexPositionScale = instancePositionScale;
+    vertexRotation = instanceRotation;
+    vertexVisible = instanceVisible(instancePositionScale, instanceRotation) ? 1.0 : 0.0;
+#else
+    vertexMatrix = instanceMatrix;
+    vertexVisible = instanceVisible(instanceMatrix) ? 1.0 : 0.0;
+#endif
+}
+)";
+
+const std::string INSTANCE_CULL_GS = R"(#version 330 core
+#ifndef COMPACT_INSTANCES
+#define COMPACT_INSTANCES 0
+#endif
+
+layout (points) in;
+layout (points, max_vertices = 1) out;
+
+#if COMPACT_INSTANCES
+in vec4 vertexPositionScale[];
+flat in uvec2 vertexRotation[];
+
+out vec4 visiblePositionScale;
+flat out uvec2 visibleRotation;
+#else
+in mat4 vertexMatrix[];
+
+out mat4 visibleMatrix;
+#endif
+in float vertexVisible[];
+
+void main() {
+    if (vertexVisible[0] > 0.5) {
+#if COMPACT_INSTANCES
+        visiblePositionScale = vertexPositionScale[0];
+        visibleRotation = vertexRotation[0];
+#else
+        visibleMatrix = vertexMatrix[0];
+#endif
+        EmitVertex();
+        EndPrimitive();
+    }
+}
+)";
+
+// compute: each group counts its survivors in shared memory and reserves
+// room for all of them with one atomic on the draw command. Instances are
+// moved as words, either format fits
+const std::string INSTANCE_CULL_COMP = R"(#version 430 core
+layout (local_size_x = 256) in;
+
+#include "instance_cull.glsl"
+
+#if COMPACT_INSTANCES
+#define INSTANCE_WORDS 6
+#else
+#define INSTANCE_WORDS 16
+#endif
+
+layout (std430, binding = 0) readonly buffer Instances { uint instances[]; };
+layout (std430, binding = 1) writeonly buffer Visible { uint visible[]; };
+layout (std430, binding = 2) buffer Command {
+    uint count;
+    uint instanceCount;
+    uint firstIndex;
+    int baseVertex;
+    uint baseInstance;
+};
+
+uniform int instanceTotal;
+
+shared uint groupCount;
+shared uint groupBase;
+
+vec4 wordsAt(int word) {
+    return uintBitsToFloat(uvec4(instances[word], instances[word + 1], instances[word + 2], instances[word + 3]));
+}
+
+bool visibleAt(int i) {
+    int word = i * INSTANCE_WORDS;
+#if COMPACT_INSTANCES
+    return instanceVisible(wordsAt(word), uvec2(instances[word + 4], instances[word + 5]));
+#else
+    return instanceVisible(mat4(wordsAt(word), wordsAt(word + 4), wordsAt(word + 8), wordsAt(word + 12)));
+#endif
+}
+
+void main() {
+    if (gl_LocalInvocationIndex == 0u)
+        groupCount = 0u;
+    barrier();
+    int i = int(gl_GlobalInvocationID.x);
+    bool keep = i < instanceTotal && visibleAt(i);
+    uint slot = 0u;
+    if (keep)
+        slot = atomicAdd(groupCount, 1u);
+    barrier();
+    if (gl_LocalInvocationIndex == 0u)
+        groupBase = atomicAdd(instanceCount, groupCount);
+    barrier();
+    if (keep) {
+        int from = i * INSTANCE_WORDS, to = int(groupBase + slot) * INSTANCE_WORDS;
+        for (int word = 0; word < INSTANCE_WORDS; word++)
+            visible[to + word] = instances[from + word];
+    }
+}
+)";
+
+const bool instanceCullGlslRegistered = (shaderSources().addBuiltin("instance_cull.glsl", INSTANCE_CULL_GLSL),
+                                         shaderSources().addBuiltin("instance_cull.vs", INSTANCE_CULL_VS),
+                                         shaderSources().addBuiltin("instance_cull.gs", INSTANCE_CULL_GS),
+                                         shaderSources().addBuiltin("instance_cull.comp", INSTANCE_CULL_COMP), true);
+
+class InstanceCuller {
+public:
+    // the culling program is added to `shaders`, finish the batch before cull();
+    // `instances` holds `count` instances in `format` (see instance_format.h) and must outlive
+    // the culler, as must `meshes`; the drawing program needs instanceDefines(format) too
+    InstanceCuller(ShaderBatch &shaders, GLuint instances, GLsizei count, const std::vector<Mesh> &meshes,
+                   InstanceFormat format = INSTANCE_MATRIX)
+        : instances(instances), count(count), meshes(meshes), format(format) {
+#ifndef INSTANCE_CULL_FEEDBACK
+        compute = glExt().computeCulling;
+#endif
+        std::string defines = instanceDefines(format);
+        if (compute) {
+            program = shaders.add({GL_COMPUTE_SHADER}, {"instance_cull.comp"}, defines);
+        } else {
+            std::vector<std::string> varyings = {"visibleMatrix"};
+            if (format == INSTANCE_COMPACT)
+                varyings = {"visiblePositionScale", "visibleRotation"};
+            program = shaders.add({GL_VERTEX_SHADER, GL_GEOMETRY_SHADER}, {"instance_cull.vs", "instance_cull.gs"},
+                                  defines, varyings);
+        }
+
+        // a sphere around every mesh's box
+        if (!meshes.empty()) {
+            glm::vec3 boundsMin = meshes[0].boundsMin, boundsMax = meshes[0].boundsMax;
+            for (const Mesh &mesh : meshes) {
+                boundsMin = glm::min(boundsMin, mesh.boundsMin);
+                boundsMax = glm::max(boundsMax, mesh.boundsMax);
+            }
+            bounds = glm::vec4((boundsMin + boundsMax) * 0.5f, glm::length(boundsMax - boundsMin) * 0.5f);
+        }
+
+        slots = compute ? 1 : FEEDBACK_SLOTS;
+        glGenBuffers(slots, visible);
+        for (int slot = 0; slot < slots; slot++) {
+            glBindBuffer(GL_ARRAY_BUFFER, visible[slot]);
+            glBufferData(GL_ARRAY_BUFFER, (size_t) count * instanceSize(format), NULL, GL_STREAM_COPY);
+        }
+
+        // the surviving instances are what the meshes read
+        setupDrawAttributes(visible[0]);
+
+        if (compute) {
+            // one command per mesh, the counter lives in the first
+            for (const Mesh &mesh : meshes) {
+                DrawElementsIndirectCommand command = {mesh.indexCount, 0, mesh.firstIndex(), mesh.baseVertex(), 0};
+                commands.push_back(command);
+            }
+            glGenBuffers(1, &commandBuffer);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                         commands.data(), GL_DYNAMIC_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        } else {
+            glGenVertexArrays(1, &cullVAO);
+            setupCullAttributes(0);
+            glGenQueries(slots, queries);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    InstanceCuller(const InstanceCuller &) = delete;
+    InstanceCuller &operator=(const InstanceCuller &) = delete;
+
+    ~InstanceCuller() {
+        glDeleteBuffers(slots, visible);
+        if (commandBuffer)
+            glDeleteBuffers(1, &commandBuffer);
+        if (cullVAO) {
+            glDeleteVertexArrays(1, &cullVAO);
+            glDeleteQueries(slots, queries);
+        }
+        delete program;
+    }
+
+    bool usesCompute() const {
+        return compute;
+    }
+
+    // the packed instances the last draw() read
+    GLuint visibleBuffer() const {
+        return visible[drawn];
+    }
+
+    // the instances from byte `offset` of the buffer on, a multiple of 256 on the compute path
+    void cull(const glm::mat4 &viewProjection, GLintptr offset = 0) {
+        Frustum frustum(viewProjection);
+        // looked up again only when the program was rebuilt
+        if (uniformRevision != program->revision()) {
+            uniformRevision = program->revision();
+            planesUniform = program->uniform("planes");
+            boundsUniform = program->uniform("bounds");
+            totalUniform = program->uniform("instanceTotal");
+        }
+        glUseProgram(program->ID);
+        glUniform4fv(planesUniform.location, 6, &frustum.planes[0].x);
+        glUniform4fv(boundsUniform.location, 1, &bounds.x);
+        if (compute) {
+            cullCompute(offset);
+        } else {
+            if (offset != cullOffset)
+                setupCullAttributes(offset);
+            cullFeedback();
+        }
+    }
+
+    // instances the last draw() drew; waits for the GPU on the compute path, for statistics
+    GLuint visibleCount() {
+        if (compute) {
+            GLuint result = 0;
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+            glGetBufferSubData(GL_DRAW_INDIRECT_BUFFER, offsetof(DrawElementsIndirectCommand, instanceCount),
+                               sizeof(GLuint), &result);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return result;
+        }
+        return counts[drawn];
+    }
+
+    // every mesh once per visible instance, with the program in use
+    void draw() {
+        if (!compute) {
+            drawn = drawSlot();
+            if (visible[drawn] != drawAttributes)
+                setupDrawAttributes(visible[drawn]);
+            for (const Mesh &mesh : meshes)
+                mesh.drawInstanced(counts[drawn]);
+            return;
+        }
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        GLuint boundVertexArray = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (meshes[i].vertexArray() != boundVertexArray) {
+                boundVertexArray = meshes[i].vertexArray();
+                glBindVertexArray(boundVertexArray);
+            }
+            glExt().drawElementsIndirect(GL_TRIANGLES, meshes[i].indexType,
+                                         (const void *) (i * sizeof(DrawElementsIndirectCommand)));
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+    }
+
+private:
+    GLuint instances;
+    GLsizei count;
+    const std::vector<Mesh> &meshes;
+    InstanceFormat format;
+    glm::vec4 bounds = glm::vec4(0.0f);
+    bool compute = false;
+    Shader *program = NULL;
+    unsigned long uniformRevision = 0;
+    UniformHandle planesUniform, boundsUniform, totalUniform;
+
+    // one buffer on the compute path, FEEDBACK_SLOTS taken in turn on the other
+    static const int FEEDBACK_SLOTS = 3;
+    int slots = 1;
+    GLuint visible[FEEDBACK_SLOTS] = {};
+    // the buffer the meshes' instance attributes read, and which slot draw() used
+    GLuint drawAttributes = 0;
+    int drawn = 0;
+
+    // compute
+    std::vector<DrawElementsIndirectCommand> commands;
+    GLuint commandBuffer = 0;
+
+    // transform feedback
+    GLuint cullVAO = 0;
+    GLintptr cullOffset = 0;
+    // the slot of the last cull(), and per slot its query, whether it was culled into and the count
+    int culling = 0;
+    GLuint queries[FEEDBACK_SLOTS] = {};
+    bool culled[FEEDBACK_SLOTS] = {};
+    bool counted[FEEDBACK_SLOTS] = {};
+    GLuint counts[FEEDBACK_SLOTS] = {};
+
+    void setupDrawAttributes(GLuint buffer) {
+        drawAttributes = buffer;
+        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        GLuint configured = 0;
+        for (const Mesh &mesh : meshes) {
+            if (mesh.vertexArray() == configured)
+                continue;
+            configured = mesh.vertexArray();
+            glBindVertexArray(configured);
+            setupInstanceAttributes(format, 3);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // whether the slot's count is in, asking the query without waiting unless `wait`
+    bool countReady(int slot, bool wait) {
+        if (!counted[slot]) {
+            GLuint available = GL_TRUE;
+            if (!wait)
+                glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available) {
+                glGetQueryObjectuiv(queries[slot], GL_QUERY_RESULT, &counts[slot]);
+                counted[slot] = true;
+            }
+        }
+        return counted[slot];
+    }
+
+    // the newest slot culled before the last cull() whose count is in, or else the
+    // oldest culled one, waited for
+    int drawSlot() {
+        for (int age = 1; age < slots; age++) {
+            int slot = (culling + slots - age) % slots;
+            if (culled[slot] && countReady(slot, false))
+                return slot;
+        }
+        for (int age = slots - 1; age >= 0; age--) {
+            int slot = (culling + slots - age) % slots;
+            if (culled[slot]) {
+                countReady(slot, true);
+                return slot;
+            }
+        }
+        return culling;
+    }
+
+    // the transform feedback pass reads the instances from `offset`
+    void setupCullAttributes(GLintptr offset) {
+        cullOffset = offset;
+        glBindVertexArray(cullVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instances);
+        // one point per instance, so advanced per vertex
+        if (format == INSTANCE_COMPACT) {
+            // the rotation as integers, so it is captured as stored
+            GLsizei stride = sizeof(CompactInstance);
+            glEnableVertexAttribArray(0);
+            glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, stride,
+                                  (void *) (offset + offsetof(CompactInstance, Position)));
+            glEnableVertexAttribArray(1);
+            glVertexAttribIPointer(1, 2, GL_UNSIGNED_INT, stride,
+                                   (void *) (offset + offsetof(CompactInstance, Rotation)));
+        } else {
+            setupInstanceAttributes(format, 0, 0, offset);
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    void cullCompute(GLintptr offset) {
+        program->setInt(totalUniform, count);
+        // counts start at 0 again
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, commandBuffer);
+        glBufferSubData(GL_DRAW_INDIRECT_BUFFER, 0, commands.size() * sizeof(DrawElementsIndirectCommand),
+                        commands.data());
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, instances, offset, (GLsizeiptr) count * instanceSize(format));
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, visible[0]);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, commandBuffer, 0, sizeof(DrawElementsIndirectCommand));
+        glExt().dispatchCompute((count + 255) / 256, 1, 1);
+
+        // the other meshes draw as many instances as the first
+        if (commands.size() > 1) {
+            glExt().memoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+            glBindBuffer(GL_COPY_READ_BUFFER, commandBuffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, commandBuffer);
+            size_t field = offsetof(DrawElementsIndirectCommand, instanceCount);
+            for (size_t i = 1; i < commands.size(); i++)
+                glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, field,
+                                    i * sizeof(DrawElementsIndirectCommand) + field, sizeof(GLuint));
+            glBindBuffer(GL_COPY_READ_BUFFER, 0);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        }
+        glExt().memoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+        for (GLuint binding = 0; binding < 3; binding++)
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+    }
+
+    void cullFeedback() {
+        culling = (culling + 1) % slots;
+        culled[culling] = true;
+        counted[culling] = false;
+        glEnable(GL_RASTERIZER_DISCARD);
+        glBindVertexArray(cullVAO);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, visible[culling]);
+        glBeginQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN, queries[culling]);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, count);
+        glEndTransformFeedback();
+        glEndQuery(GL_TRANSFORM_FEEDBACK_PRIMITIVES_WRITTEN);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glDisable(GL_RASTERIZER_DISCARD);
+    }
+};
+
+#endif
@@ -0,0 +1,120 @@
+#ifndef INSTANCE_FORMAT_H
+#define INSTANCE_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "shader_source.h"
+
+/**
+ * The per instance data an instanced draw can read.
+ *
+ * INSTANCE_MATRIX is a plain glm::mat4, 64 bytes over four attributes, and
+ * takes any transform. INSTANCE_COMPACT is a 24 byte CompactInstance:
+ *
+ *     position   3 x float
+ *     scale      float, the same on every axis
+ *     rotation   unit quaternion, 4 x snorm16 (x, y, z, w)
+ *
+ * over two attributes, which the vertex shader turns back into a transform
+ * (COMPACT_INSTANCES in 04_advanced_opengl/shader/instancing.vs, using
+ * instance_format.glsl). The quaternion is off by at most about 1/32767 per
+ * component, a few thousandths of a degree.
+ */
+
+enum InstanceFormat {
+    INSTANCE_MATRIX,
+    INSTANCE_COMPACT
+};
+
+struct CompactInstance {
+    float Position[3];
+    float Scale;
+    int16_t Rotation[4];
+};
+
+static_assert(sizeof(CompactInstance) == 24, "CompactInstance layout changed");
+
+size_t instanceSize(InstanceFormat format) {
+    return format == INSTANCE_COMPACT ? sizeof(CompactInstance) : sizeof(glm::mat4);
+}
+
+// what the shaders #define for a format
+std::string instanceDefines(InstanceFormat format) {
+    return format == INSTANCE_COMPACT ? "#define COMPACT_INSTANCES 1\n" : "";
+}
+
+// rounded to nearest, half away from zero
+int16_t packSnorm16(float value) {
+    float scaled = std::min(std::max(value, -1.0f), 1.0f) * 32767.0f;
+    return (int16_t) (scaled + std::copysign(0.5f, scaled));
+}
+
+CompactInstance packInstance(const glm::vec3 &position, float scale, const glm::quat &rotation) {
+    CompactInstance instance;
+    for (int axis = 0; axis < 3; axis++)
+        instance.Position[axis] = position[axis];
+    instance.Scale = scale;
+    glm::quat q = glm::normalize(rotation);
+    instance.Rotation[0] = packSnorm16(q.x);
+    instance.Rotation[1] = packSnorm16(q.y);
+    instance.Rotation[2] = packSnorm16(q.z);
+    instance.Rotation[3] = packSnorm16(q.w);
+    return instance;
+}
+
+// the transform the shader rebuilds
+glm::mat4 unpackInstance(const CompactInstance &instance) {
+    glm::quat q(instance.Rotation[3] / 32767.0f, instance.Rotation[0] / 32767.0f,
+                instance.Rotation[1] / 32767.0f, instance.Rotation[2] / 32767.0f);
+    glm::mat4 m = glm::mat4_cast(glm::normalize(q)) * instance.Scale;
+    m[3] = glm::vec4(instance.Position[0], instance.Position[1], instance.Position[2], 1.0f);
+    return m;
+}
+
+// attributes from `location` on of the bound VAO, reading the bound
+// GL_ARRAY_BUFFER from byte `offset`, advanced once per `divisor` instances
+void setupInstanceAttributes(InstanceFormat format, GLuint location, GLuint divisor = 1, GLintptr offset = 0) {
+    if (format == INSTANCE_COMPACT) {
+        GLsizei stride = sizeof(CompactInstance);
+        glEnableVertexAttribArray(location);
+        glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride,
+                              (void*)(offset + offsetof(CompactInstance, Position)));
+        glEnableVertexAttribArray(location + 1);
+        glVertexAttribPointer(location + 1, 4, GL_SHORT, GL_TRUE, stride,
+                              (void*)(offset + offsetof(CompactInstance, Rotation)));
+        glVertexAttribDivisor(location, divisor);
+        glVertexAttribDivisor(location + 1, divisor);
+        return;
+    }
+    for (GLuint column = 0; column < 4; column++) {
+        glEnableVertexAttribArray(location + column);
+        glVertexAttribPointer(location + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4),
+                              (void*)(offset + column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(location + column, divisor);
+    }
+}
+
+const std::string INSTANCE_FORMAT_GLSL = R"(
+// v rotated by the unit quaternion q (x, y, z, w)
+vec3 quaternionRotate(vec4 q, vec3 v) {
+    return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+// two snorm16 packed in a word, low half first, as CompactInstance stores them
+vec2 unpackSnorm16x2(uint word) {
+    ivec2 v = ivec2(int(word << 16u) >> 16, int(word) >> 16);
+    return max(vec2(v) / 32767.0, -1.0);
+}
+)";
+
+const bool instanceFormatGlslRegistered = (shaderSources().addBuiltin("instance_format.glsl", INSTANCE_FORMAT_GLSL), true);
+
+#endif
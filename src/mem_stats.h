@@ -0,0 +1,34 @@
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <cstdio>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+// Resident set size of this process in bytes, 0 where /proc is missing
+size_t residentSetBytes() {
+    long pages = 0, resident = 0;
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (file) {
+        if (fscanf(file, "%ld %ld", &pages, &resident) != 2)
+            resident = 0;
+        fclose(file);
+    }
+    return (size_t) resident * sysconf(_SC_PAGESIZE);
+}
+
+// Give freed heap pages back to the system so the RSS reflects them
+void trimHeap() {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+}
+
+void printResidentSet(const char *label) {
+    trimHeap();
+    std::printf("RSS %s: %.1f MB\n", label, residentSetBytes() / (1024.0 * 1024.0));
+}
+
+#endif
@@ -4,6 +4,8 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cstring>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "shader_s.h"
@@ -11,103 +13,495 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <assimp/postprocess.h>
+#include "vertex_format.h"
+#include "geometry_arena.h"
 
 using namespace std;
 
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-};
-
 struct Texture {
     unsigned int id;
     string type;
     aiString path;
 };
 
+// 能索引 vertexCount 个顶点的最小索引类型；-DMESH_NO_SMALL_INDICES 一律 32 位。
+// 8 位索引不少 GPU 要由驱动转换，-DMESH_BYTE_INDICES 才使用
+GLenum indexTypeFor(unsigned int vertexCount) {
+#ifndef MESH_NO_SMALL_INDICES
+#ifdef MESH_BYTE_INDICES
+    if (vertexCount <= 1u << 8)
+        return GL_UNSIGNED_BYTE;
+#endif
+    if (vertexCount <= 1u << 16)
+        return GL_UNSIGNED_SHORT;
+#endif
+    return GL_UNSIGNED_INT;
+}
+
+size_t indexSize(GLenum indexType) {
+    return indexType == GL_UNSIGNED_BYTE ? 1 : indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+// 网格绘制路径上的 GL 调用次数，由 demo 每帧读取并清零
+struct MeshDrawStats {
+    unsigned long vertexArrayBinds = 0;
+    unsigned long textureBinds = 0;
+    unsigned long drawCalls = 0;
+    // Model 按视锥剔除时的网格数，见 frustum.h
+    unsigned long meshesVisible = 0;
+    unsigned long meshesCulled = 0;
+};
+
+MeshDrawStats meshDrawStats;
+
+// 32 位索引按 indexType 收窄成缓冲里的字节
+void narrowIndices(const unsigned int *indices, size_t count, GLenum indexType, vector<unsigned char> &out) {
+    out.resize(count * indexSize(indexType));
+    if (indexType == GL_UNSIGNED_SHORT) {
+        unsigned short *dst = (unsigned short *) out.data();
+        for (size_t i = 0; i < count; i++)
+            dst[i] = (unsigned short) indices[i];
+    } else if (indexType == GL_UNSIGNED_BYTE) {
+        for (size_t i = 0; i < count; i++)
+            out[i] = (unsigned char) indices[i];
+    } else {
+        memcpy(out.data(), indices, count * sizeof(unsigned int));
+    }
+}
+
 class Mesh {
 public:
 
     /*  网格数据  */
 
+    // releaseCpuData() 之后这两个为空，数据只留在显存里
     vector<Vertex> vertices;
     vector<unsigned int> indices;
     vector<Texture> textures;
 
+    // 上传时记下，绘制和剔除不依赖内存中的顶点数据
+    unsigned int vertexCount = 0;
+    unsigned int indexCount = 0;
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    // 显存中顶点的格式；VERTEX_PACKED 需要着色器定义 PACKED_VERTICES，见 vertex_format.h
+    VertexFormat vertexFormat = VERTEX_FLOAT;
+    // 按顶点数选定，见 indexTypeFor()
+    GLenum indexType = GL_UNSIGNED_INT;
+
     /*  函数  */
 
+    // 以下构造函数的 arena 不为 NULL 时，顶点和索引放进它的共享缓冲（见 geometry_arena.h），
+    // 否则网格独占自己的 VAO / VBO / EBO
+
+    // 传入的数据直接移入网格，调用方用 std::move 即可避免拷贝
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices,
-        vector<Texture> textures) {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
+        vector<Texture> textures, VertexFormat vertexFormat = VERTEX_FLOAT, GeometryArena *arena = NULL)
+        : vertices(std::move(vertices)), indices(std::move(indices)),
+          textures(std::move(textures)), vertexFormat(vertexFormat), arena(arena) {
+        setupMesh(true);
+    }
+
+    // 分块上传：构造时只分配缓冲，数据由 uploadChunk() 分几帧写入，写完才能绘制
+    struct Deferred {};
 
-        setupMesh();
+    Mesh(vector<Vertex> vertices, vector<unsigned int> indices,
+        vector<Texture> textures, Deferred, VertexFormat vertexFormat = VERTEX_FLOAT,
+        GeometryArena *arena = NULL)
+        : vertices(std::move(vertices)), indices(std::move(indices)),
+          textures(std::move(textures)), vertexFormat(vertexFormat), arena(arena) {
+        setupMesh(false);
     }
 
-    void draw(Shader shader) {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        for(unsigned int i = 0; i < textures.size(); i++) {
-            glActiveTexture(GL_TEXTURE0 + i); // 在绑定之前激活相应的纹理单元
-            // 获取纹理序号（diffuse_textureN 中的 N）
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++);
-            if (number[0] != '1')
-                std::cout << name + number << std::endl;
-            shader.setInt("material." + name + number, i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+    // 数据已在内存某处排好（如 mmap 的烘焙文件），直接上传，不逐顶点处理；
+    // keepCpuData 时才整块拷进 vertices / indices
+    Mesh(const Vertex *vertexData, unsigned int vertexCount,
+        const unsigned int *indexData, unsigned int indexCount,
+        vector<Texture> textures, glm::vec3 boundsMin, glm::vec3 boundsMax, bool keepCpuData,
+        VertexFormat vertexFormat = VERTEX_FLOAT, GeometryArena *arena = NULL)
+        : textures(std::move(textures)), vertexCount(vertexCount), indexCount(indexCount),
+          boundsMin(boundsMin), boundsMax(boundsMax), vertexFormat(vertexFormat), arena(arena) {
+        if (keepCpuData) {
+            vertices.assign(vertexData, vertexData + vertexCount);
+            indices.assign(indexData, indexData + indexCount);
         }
-        glActiveTexture(GL_TEXTURE0);
+        setupBuffers(vertexData, indexData);
+    }
+
+    // 网格独占它的 GPU 资源：只能移动，不能拷贝
+    Mesh(const Mesh &) = delete;
+    Mesh &operator=(const Mesh &) = delete;
+
+    Mesh(Mesh &&other) noexcept {
+        *this = std::move(other);
+    }
+
+    Mesh &operator=(Mesh &&other) noexcept {
+        if (this != &other) {
+            release();
+            vertices = std::move(other.vertices);
+            indices = std::move(other.indices);
+            packedVertices = std::move(other.packedVertices);
+            packedIndices = std::move(other.packedIndices);
+            textures = std::move(other.textures);
+            samplerNames = std::move(other.samplerNames);
+            bindingTables = std::move(other.bindingTables);
+            vertexCount = other.vertexCount;
+            indexCount = other.indexCount;
+            boundsMin = other.boundsMin;
+            boundsMax = other.boundsMax;
+            vertexFormat = other.vertexFormat;
+            indexType = other.indexType;
+            uploadedBytes = other.uploadedBytes;
+            arena = other.arena;
+            range = other.range;
+            VAO = other.VAO;
+            VBO = other.VBO;
+            EBO = other.EBO;
+            other.VAO = other.VBO = other.EBO = 0;
+            other.arena = NULL;
+        }
+        return *this;
+    }
+
+    ~Mesh() {
+        release();
+    }
+
+    void draw(const Shader &shader) const {
+        GLuint boundVertexArray = 0;
+        draw(shader, boundVertexArray);
+        glBindVertexArray(0);
+        meshDrawStats.vertexArrayBinds++;
+    }
+
+    // 连续绘制多个网格用：boundVertexArray 是当前绑定的 VAO，相同就不再绑定，画完也不解绑
+    void draw(const Shader &shader, GLuint &boundVertexArray) const {
+        bindTextures(shader);
 
         // 绘制网格
+        if (VAO != boundVertexArray) {
+            glBindVertexArray(VAO);
+            boundVertexArray = VAO;
+            meshDrawStats.vertexArrayBinds++;
+        }
+        if (arena)
+            glDrawElementsBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)range.indexOffset, range.baseVertex);
+        else
+            glDrawElements(GL_TRIANGLES, indexCount, indexType, 0);
+        meshDrawStats.drawCalls++;
+    }
+
+    // 纹理和压缩顶点的包围盒，shader 须是当前程序
+    void bindTextures(const Shader &shader) const {
+        const BindingTable &table = bindingsFor(shader);
+        for (const TextureBinding &binding : table.bindings) {
+            glActiveTexture(GL_TEXTURE0 + binding.unit); // 在绑定之前激活相应的纹理单元
+            glBindTexture(GL_TEXTURE_2D, binding.texture);
+        }
+        glActiveTexture(GL_TEXTURE0);
+        meshDrawStats.textureBinds += table.bindings.size();
+        // 压缩的位置是包围盒内的 0..1，由着色器还原
+        if (vertexFormat == VERTEX_PACKED) {
+            shader.setVec3(table.packedBoundsMin, boundsMin);
+            shader.setVec3(table.packedBoundsExtent, boundsMax - boundsMin);
+        }
+    }
+
+    // 间接绘制命令用：VAO，索引在缓冲中的起点（以索引计）和基准顶点
+    GLuint vertexArray() const {
+        return VAO;
+    }
+
+    GLuint firstIndex() const {
+        return range.indexOffset / indexStride();
+    }
+
+    GLint baseVertex() const {
+        return range.baseVertex;
+    }
+
+    // 实例化绘制，实例属性由调用方设在 getVaoName() 上
+    void drawInstanced(GLsizei instances) const {
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawElementsInstancedBaseVertex(GL_TRIANGLES, indexCount, indexType, (void*)range.indexOffset,
+                                          instances, range.baseVertex);
         glBindVertexArray(0);
     }
 
+    // 显存中每个顶点的字节数
+    size_t vertexStride() const {
+        return vertexSize(vertexFormat);
+    }
+
+    size_t indexStride() const {
+        return indexSize(indexType);
+    }
+
+    // 顶点和索引总共要上传的字节数
+    size_t bufferBytes() const {
+        return (size_t) vertexCount * vertexStride() + (size_t) indexCount * indexStride();
+    }
+
+    bool uploaded() const {
+        return uploadedBytes == bufferBytes();
+    }
+
+    // 接着上次的位置最多写入 maxBytes（至少一个顶点或索引），返回写入的字节数；
+    // 经 GL_COPY_WRITE_BUFFER 写入，不会改动当前绑定的 VAO
+    size_t uploadChunk(size_t maxBytes) {
+        size_t vertexBytes = (size_t) vertexCount * vertexStride();
+        size_t written = 0;
+        if (uploadedBytes < vertexBytes) {
+            size_t offset = uploadedBytes;
+            size_t size = std::min(vertexBytes - offset, std::max(maxBytes, vertexStride()));
+            const char *source = vertexFormat == VERTEX_PACKED ? (const char *) packedVertices.data()
+                                                               : (const char *) vertices.data();
+            glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.vertexOffset + offset, size, source + offset);
+            uploadedBytes += size;
+            written += size;
+            // 压缩后的副本只为上传而留
+            if (uploadedBytes == vertexBytes)
+                vector<PackedVertex>().swap(packedVertices);
+        }
+        if (written < maxBytes && uploadedBytes >= vertexBytes && !uploaded()) {
+            size_t offset = uploadedBytes - vertexBytes;
+            size_t size = std::min(bufferBytes() - uploadedBytes,
+                                   std::max(maxBytes - written, indexStride()));
+            const char *source = indexType == GL_UNSIGNED_INT ? (const char *) indices.data()
+                                                              : (const char *) packedIndices.data();
+            glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+            glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset + offset, size, source + offset);
+            uploadedBytes += size;
+            written += size;
+            if (uploaded())
+                vector<unsigned char>().swap(packedIndices);
+        }
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        return written;
+    }
+
+    // 在共享缓冲里时，别的网格也用这个 VAO
     GLuint getVaoName() {
         return VAO;
     }
 
+    // 只保留显存中的副本，释放内存里的顶点和索引
+    void releaseCpuData() {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    bool hasCpuData() const {
+        return vertices.size() == vertexCount && indices.size() == indexCount;
+    }
+
+    // 需要数据的工具用：内存里没有就从缓冲对象读回
+    // 压缩格式读回的是解码后的近似值
+    vector<Vertex> readVertices() const {
+        if (hasCpuData())
+            return vertices;
+        vector<Vertex> data(vertexCount);
+        glBindBuffer(GL_COPY_READ_BUFFER, VBO);
+        if (vertexFormat == VERTEX_PACKED) {
+            vector<PackedVertex> packed(vertexCount);
+            glGetBufferSubData(GL_COPY_READ_BUFFER, range.vertexOffset, packed.size() * sizeof(PackedVertex),
+                               packed.data());
+            for (size_t i = 0; i < packed.size(); i++)
+                data[i] = unpackVertex(packed[i], boundsMin, boundsMax);
+        } else {
+            glGetBufferSubData(GL_COPY_READ_BUFFER, range.vertexOffset, data.size() * sizeof(Vertex), data.data());
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return data;
+    }
+
+    vector<unsigned int> readIndices() const {
+        if (hasCpuData())
+            return indices;
+        vector<unsigned int> data(indexCount);
+        vector<unsigned char> bytes(indexCount * indexStride());
+        glBindBuffer(GL_COPY_READ_BUFFER, EBO);
+        glGetBufferSubData(GL_COPY_READ_BUFFER, range.indexOffset, bytes.size(), bytes.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        for (size_t i = 0; i < data.size(); i++) {
+            if (indexType == GL_UNSIGNED_BYTE)
+                data[i] = bytes[i];
+            else if (indexType == GL_UNSIGNED_SHORT)
+                data[i] = ((const unsigned short *) bytes.data())[i];
+            else
+                data[i] = ((const unsigned int *) bytes.data())[i];
+        }
+        return data;
+    }
+
+    size_t cpuBytes() const {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+               packedVertices.capacity() * sizeof(PackedVertex) + packedIndices.capacity();
+    }
+
+    bool hasTexture(const char *type) const {
+        for (const Texture &texture : textures)
+            if (texture.type == type)
+                return true;
+        return false;
+    }
+
 private:
 
     /*  渲染数据  */
 
-    unsigned int VAO, VBO, EBO;
+    // "material.texture_diffuseN" 等采样器名，构造时拼好
+    vector<string> samplerNames;
+
+    // 每个着色器程序一张绑定表：纹理单元由程序固定分配（Shader::samplerUnit），
+    // 程序没用到的采样器直接略过，绘制时只剩 glBindTexture
+    struct TextureBinding {
+        GLuint unit;
+        GLuint texture;
+    };
+    struct BindingTable {
+        unsigned long revision;
+        vector<TextureBinding> bindings;
+        UniformHandle packedBoundsMin;
+        UniformHandle packedBoundsExtent;
+    };
+    mutable vector<BindingTable> bindingTables;
+
+    // VERTEX_PACKED 分块上传时待写入的顶点，以及收窄后待写入的索引
+    vector<PackedVertex> packedVertices;
+    vector<unsigned char> packedIndices;
+
+    // arena 为 NULL 时 range 全为 0，缓冲归网格自己
+    GeometryArena *arena = NULL;
+    GeometryArena::Range range;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    size_t uploadedBytes = 0;
 
     /*  函数  */
 
-    void setupMesh() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+    const BindingTable &bindingsFor(const Shader &shader) const {
+        for (const BindingTable &table : bindingTables)
+            if (table.revision == shader.revision())
+                return table;
+        // 只在第一次用某个程序绘制时走到这里
+        if (bindingTables.size() >= 8)
+            bindingTables.clear();
+        BindingTable table;
+        table.revision = shader.revision();
+        for (size_t i = 0; i < textures.size(); i++) {
+            GLint unit = shader.samplerUnit(samplerNames[i]);
+            if (unit >= 0)
+                table.bindings.push_back(TextureBinding{(GLuint) unit, textures[i].id});
+        }
+        if (vertexFormat == VERTEX_PACKED) {
+            table.packedBoundsMin = shader.uniform("packedBoundsMin");
+            table.packedBoundsExtent = shader.uniform("packedBoundsExtent");
+        }
+        bindingTables.push_back(std::move(table));
+        return bindingTables.back();
+    }
 
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    void release() {
+        // 被移走的网格什么也不持有
+        if (!VAO)
+            return;
+        if (arena) {
+            arena->release(range);
+            VAO = VBO = EBO = 0;
+            return;
+        }
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+    }
+
+    // fill = false 时缓冲只分配不填充，见 uploadChunk()
+    void setupMesh(bool fill) {
+        vertexCount = vertices.size();
+        indexCount = indices.size();
+        if (!vertices.empty()) {
+            boundsMin = boundsMax = vertices[0].Position;
+            for (const Vertex &vertex : vertices) {
+                boundsMin = glm::min(boundsMin, vertex.Position);
+                boundsMax = glm::max(boundsMax, vertex.Position);
+            }
+        }
+        setupBuffers(fill ? vertices.data() : NULL, fill ? indices.data() : NULL);
+    }
+
+    // 计数和包围盒已经确定；数据为 NULL 时缓冲只分配
+    void setupBuffers(const Vertex *vertexData, const unsigned int *indexData) {
+        unsigned int diffuseNr = 1;
+        unsigned int specularNr = 1;
+        for (const Texture &texture : textures) {
+            // 获取纹理序号（diffuse_textureN 中的 N）
+            string number;
+            const string &name = texture.type;
+            if(name == "texture_diffuse")
+                number = std::to_string(diffuseNr++);
+            else if(name == "texture_specular")
+                number = std::to_string(specularNr++);
+            if (number[0] != '1')
+                std::cout << name + number << std::endl;
+            samplerNames.push_back("material." + name + number);
+        }
 
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
+        // 压缩格式先在内存里打包；分块上传时留到 uploadChunk() 写完
+        const void *bufferData = vertexData;
+        if (vertexFormat == VERTEX_PACKED) {
+            packedVertices.resize(vertexCount);
+            packVertices(vertexData ? vertexData : vertices.data(), vertexCount, boundsMin, boundsMax,
+                         packedVertices.data());
+            bufferData = vertexData ? packedVertices.data() : NULL;
+        }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), 
-                    &indices[0], GL_STATIC_DRAW);
+        // 索引同样先收窄
+        indexType = indexTypeFor(vertexCount);
+        const void *indexBuffer = indexData;
+        if (indexType != GL_UNSIGNED_INT) {
+            narrowIndices(indexData ? indexData : indices.data(), indexCount, indexType, packedIndices);
+            indexBuffer = indexData ? packedIndices.data() : NULL;
+        }
+        size_t vertexBytes = (size_t) vertexCount * vertexStride();
+        size_t indexBytes = (size_t) indexCount * indexStride();
 
-        // 顶点位置
-        glEnableVertexAttribArray(0);   
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // 顶点法线
-        glEnableVertexAttribArray(1);   
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // 顶点纹理坐标
-        glEnableVertexAttribArray(2);   
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        if (arena) {
+            // 共享缓冲和 VAO 早已建好，只写入分到的区间
+            range = arena->allocate(vertexFormat, vertexCount, indexBytes);
+            VAO = range.vao;
+            VBO = range.vbo;
+            EBO = range.ebo;
+            if (bufferData) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, VBO);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, range.vertexOffset, vertexBytes, bufferData);
+            }
+            if (indexBuffer) {
+                glBindBuffer(GL_COPY_WRITE_BUFFER, EBO);
+                glBufferSubData(GL_COPY_WRITE_BUFFER, range.indexOffset, indexBytes, indexBuffer);
+            }
+            glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        } else {
+            glGenVertexArrays(1, &VAO);
+            glGenBuffers(1, &VBO);
+            glGenBuffers(1, &EBO);
 
-        glBindVertexArray(0);
+            glBindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, vertexBytes, bufferData, GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexBuffer, GL_STATIC_DRAW);
+            // 位置、法线、纹理坐标
+            setupVertexAttributes(vertexFormat);
+            glBindVertexArray(0);
+        }
+        if (vertexData)
+            vector<PackedVertex>().swap(packedVertices);
+        if (indexData)
+            vector<unsigned char>().swap(packedIndices);
+        uploadedBytes = vertexData ? bufferBytes() : 0;
     }
 };
 
@@ -0,0 +1,294 @@
+#ifndef MESH_OPTIMIZE_H
+#define MESH_OPTIMIZE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "mesh.h"
+
+/**
+ * Import time reordering of indexed triangle lists, all CPU only:
+ *
+ * - optimizeVertexCache(): Tom Forsyth's linear-speed vertex cache
+ *   optimisation, so consecutive triangles reuse transformed vertices;
+ * - optimizeOverdraw(): cuts that order into clusters at cache restarts
+ *   and draws the outward facing clusters first, as long as the cache
+ *   efficiency stays within `threshold` of the optimised order;
+ * - optimizeVertexFetch(): renumbers vertices in first use order so the
+ *   vertex buffer is read front to back.
+ *
+ * analyzeVertexCache() measures the result against a FIFO cache:
+ * ACMR is transformed vertices per triangle (0.5 is the ideal on a closed
+ * grid, 3 the worst), ATVR is transformed vertices per vertex (1 ideal).
+ */
+
+struct VertexCacheStats {
+    unsigned int triangles = 0;
+    unsigned int vertices = 0;
+    unsigned int transforms = 0;
+
+    float acmr() const {
+        return triangles ? (float) transforms / triangles : 0.0f;
+    }
+
+    float atvr() const {
+        return vertices ? (float) transforms / vertices : 0.0f;
+    }
+
+    VertexCacheStats &operator+=(const VertexCacheStats &other) {
+        triangles += other.triangles;
+        vertices += other.vertices;
+        transforms += other.transforms;
+        return *this;
+    }
+};
+
+// cache size of the simulation; 16-32 matches most GPUs
+const unsigned int VERTEX_CACHE_SIZE = 32;
+
+VertexCacheStats analyzeVertexCache(const std::vector<unsigned int> &indices, unsigned int vertexCount,
+                                    unsigned int cacheSize = VERTEX_CACHE_SIZE) {
+    VertexCacheStats stats;
+    stats.triangles = indices.size() / 3;
+    // a vertex is cached while fewer than cacheSize misses happened since it was loaded
+    std::vector<unsigned int> loadedAt(vertexCount, 0);
+    std::vector<bool> used(vertexCount, false);
+    unsigned int time = cacheSize + 1;
+    for (unsigned int index : indices) {
+        if (!used[index]) {
+            used[index] = true;
+            stats.vertices++;
+        }
+        if (time - loadedAt[index] > cacheSize) {
+            loadedAt[index] = time++;
+            stats.transforms++;
+        }
+    }
+    return stats;
+}
+
+namespace forsyth {
+
+const int CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float vertexScore(int cachePosition, unsigned int remainingTriangles) {
+    // a vertex without triangles left is of no use any more
+    if (remainingTriangles == 0)
+        return -1.0f;
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // used by the last triangle, no matter which of its three slots
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scale = 1.0f / (CACHE_SIZE - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scale, CACHE_DECAY_POWER);
+        }
+    }
+    // favour vertices with few triangles left, to finish them off
+    score += VALENCE_BOOST_SCALE * std::pow((float) remainingTriangles, -VALENCE_BOOST_POWER);
+    return score;
+}
+
+}
+
+void optimizeVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+
+    // triangles of each vertex, in one array
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for (unsigned int index : indices)
+        remaining[index]++;
+    std::vector<unsigned int> offsets(vertexCount + 1, 0);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        offsets[v + 1] = offsets[v] + remaining[v];
+    std::vector<unsigned int> adjacency(indices.size());
+    std::vector<unsigned int> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t t = 0; t < triangleCount; t++)
+        for (int k = 0; k < 3; k++)
+            adjacency[fill[indices[3 * t + k]]++] = t;
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScores(vertexCount);
+    for (unsigned int v = 0; v < vertexCount; v++)
+        vertexScores[v] = forsyth::vertexScore(-1, remaining[v]);
+    std::vector<bool> emitted(triangleCount, false);
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    // three extra slots for the vertices pushed in front before trimming
+    std::vector<unsigned int> cache, nextCache;
+    cache.reserve(forsyth::CACHE_SIZE + 3);
+    nextCache.reserve(forsyth::CACHE_SIZE + 3);
+    size_t cursor = 0;
+    long best = -1;
+
+    for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+        if (best < 0) {
+            // nothing in the cache to continue with: take the next triangle in input order
+            while (emitted[cursor])
+                cursor++;
+            best = cursor;
+        }
+        unsigned int triangle = best;
+        emitted[triangle] = true;
+        const unsigned int *corners = &indices[3 * triangle];
+        result.insert(result.end(), corners, corners + 3);
+
+        // the emitted triangle's vertices go to the front, the rest shift back
+        nextCache.clear();
+        for (int k = 0; k < 3; k++)
+            if (std::find(nextCache.begin(), nextCache.end(), corners[k]) == nextCache.end())
+                nextCache.push_back(corners[k]);
+        for (unsigned int v : cache)
+            if (v != corners[0] && v != corners[1] && v != corners[2])
+                nextCache.push_back(v);
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = corners[k];
+            // drop the triangle from the vertex's list
+            unsigned int *begin = &adjacency[offsets[v]];
+            unsigned int *end = begin + remaining[v];
+            *std::find(begin, end, triangle) = end[-1];
+            remaining[v]--;
+        }
+        // vertices falling out of the cache
+        for (size_t i = forsyth::CACHE_SIZE; i < nextCache.size(); i++) {
+            cachePosition[nextCache[i]] = -1;
+            vertexScores[nextCache[i]] = forsyth::vertexScore(-1, remaining[nextCache[i]]);
+        }
+        if (nextCache.size() > (size_t) forsyth::CACHE_SIZE)
+            nextCache.resize(forsyth::CACHE_SIZE);
+        cache.swap(nextCache);
+
+        // rescore what is still cached, and the triangles around it
+        for (size_t i = 0; i < cache.size(); i++)
+            cachePosition[cache[i]] = i;
+        for (unsigned int v : cache)
+            vertexScores[v] = forsyth::vertexScore(cachePosition[v], remaining[v]);
+        best = -1;
+        float bestScore = -1.0f;
+        for (unsigned int v : cache) {
+            for (unsigned int i = offsets[v]; i < offsets[v] + remaining[v]; i++) {
+                unsigned int t = adjacency[i];
+                const unsigned int *c = &indices[3 * t];
+                float score = vertexScores[c[0]] + vertexScores[c[1]] + vertexScores[c[2]];
+                if (score > bestScore) {
+                    bestScore = score;
+                    best = t;
+                }
+            }
+        }
+    }
+    indices.swap(result);
+}
+
+// cache restarts, i.e. triangles with all three vertices missed, start a new cluster
+std::vector<unsigned int> vertexCacheClusters(const std::vector<unsigned int> &indices, unsigned int vertexCount,
+                                              unsigned int cacheSize = VERTEX_CACHE_SIZE) {
+    std::vector<unsigned int> starts;
+    std::vector<unsigned int> loadedAt(vertexCount, 0);
+    unsigned int time = cacheSize + 1;
+    for (size_t t = 0; t < indices.size() / 3; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            unsigned int index = indices[3 * t + k];
+            if (time - loadedAt[index] > cacheSize) {
+                loadedAt[index] = time++;
+                misses++;
+            }
+        }
+        if (t == 0 || misses == 3)
+            starts.push_back(t);
+    }
+    return starts;
+}
+
+void optimizeOverdraw(std::vector<unsigned int> &indices, const std::vector<Vertex> &vertices,
+                      float threshold = 1.05f) {
+    size_t triangleCount = indices.size() / 3;
+    if (triangleCount == 0)
+        return;
+    std::vector<unsigned int> starts = vertexCacheClusters(indices, vertices.size());
+    if (starts.size() < 2)
+        return;
+    starts.push_back(triangleCount);
+
+    // area weighted centroid and normal of every cluster
+    size_t clusterCount = starts.size() - 1;
+    std::vector<glm::vec3> centroids(clusterCount), normals(clusterCount);
+    glm::vec3 meshCentroid(0.0f);
+    float meshArea = 0.0f;
+    for (size_t c = 0; c < clusterCount; c++) {
+        glm::vec3 centroid(0.0f), normal(0.0f);
+        float area = 0.0f;
+        for (unsigned int t = starts[c]; t < starts[c + 1]; t++) {
+            const glm::vec3 &a = vertices[indices[3 * t]].Position;
+            const glm::vec3 &b = vertices[indices[3 * t + 1]].Position;
+            const glm::vec3 &d = vertices[indices[3 * t + 2]].Position;
+            glm::vec3 cross = glm::cross(b - a, d - a);
+            float triangleArea = glm::length(cross);
+            centroid += (a + b + d) * (triangleArea / 3.0f);
+            normal += cross;
+            area += triangleArea;
+        }
+        centroids[c] = area > 0.0f ? centroid / area : vertices[indices[3 * starts[c]]].Position;
+        float length = glm::length(normal);
+        normals[c] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        meshCentroid += centroid;
+        meshArea += area;
+    }
+    if (meshArea > 0.0f)
+        meshCentroid /= meshArea;
+
+    // clusters facing away from the centre occlude the rest, draw them first
+    std::vector<float> sortKeys(clusterCount);
+    std::vector<unsigned int> order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        sortKeys[c] = glm::dot(centroids[c] - meshCentroid, normals[c]);
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [&](unsigned int a, unsigned int b) { return sortKeys[a] > sortKeys[b]; });
+
+    std::vector<unsigned int> result;
+    result.reserve(indices.size());
+    for (unsigned int c : order)
+        result.insert(result.end(), indices.begin() + 3 * starts[c], indices.begin() + 3 * starts[c + 1]);
+
+    float before = analyzeVertexCache(indices, vertices.size()).acmr();
+    float after = analyzeVertexCache(result, vertices.size()).acmr();
+    if (after <= before * threshold)
+        indices.swap(result);
+}
+
+// renumber vertices in first use order and drop unused ones
+void optimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+    std::vector<Vertex> result;
+    result.reserve(vertices.size());
+    for (unsigned int &index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = result.size();
+            result.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    vertices.swap(result);
+}
+
+// all three passes, in the order they depend on each other
+void optimizeMesh(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices) {
+    optimizeVertexCache(indices, vertices.size());
+    optimizeOverdraw(indices, vertices);
+    optimizeVertexFetch(vertices, indices);
+}
+
+#endif
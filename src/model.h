@@ -4,201 +4,572 @@
 #include <iostream>
 #include <string>
 #include <vector>
+#include <cstdint>
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include "shader_s.h"
+#include "shader_variants.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include "mesh.h"
+#include "indirect_draw.h"
+#include "frustum.h"
+#include "baked_model.h"
+#include "mesh_optimize.h"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 unsigned int textureFromFile(string filepath, string directory);
+string texturePath(string filepath, string directory);
+TextureCache::Request materialTextureRequest(const Texture &texture, const string &directory);
+
+// -DMESH_GPU_RESIDENT drops the CPU copy of every mesh once it is uploaded
+#ifdef MESH_GPU_RESIDENT
+const bool MODEL_KEEP_CPU_DATA = false;
+#else
+const bool MODEL_KEEP_CPU_DATA = true;
+#endif
+
+// -DMODEL_NO_OPTIMIZE 保持 Assimp 给出的索引和顶点顺序
+#ifdef MODEL_NO_OPTIMIZE
+const bool MODEL_OPTIMIZE_MESHES = false;
+#else
+const bool MODEL_OPTIMIZE_MESHES = true;
+#endif
+
+// 顶点多于此数的网格导入时按三角形顺序拆开，每块都能用 16 位索引（见 indexTypeFor()）
+#ifdef MESH_NO_SMALL_INDICES
+const unsigned int MESH_SPLIT_VERTICES = 0;
+#else
+const unsigned int MESH_SPLIT_VERTICES = 1 << 16;
+#endif
+
+// 模型网格默认放进共享的 geometryArena()；-DMESH_NO_ARENA 每个网格独占缓冲，用来对比绑定次数
+GeometryArena *defaultGeometryArena() {
+#ifdef MESH_NO_ARENA
+    return NULL;
+#else
+    return &geometryArena();
+#endif
+}
 
 unsigned int loadTexture(string filepath, int warp_s = GL_REPEAT, int warp_t = GL_REPEAT, bool gammaCorrection = false);
 
-class Model {
-public:
+// 一个网格导入后的内存数据，还没有任何 GL 对象
+struct MeshData {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<Texture> textures;
+};
 
-    /*  模型数据  */
+// 纹理请求对应的 meshes[mesh].textures[texture]
+struct TextureSlot {
+    size_t mesh;
+    size_t texture;
+};
 
-    vector<Mesh> meshes;
-    string directory;
-    vector<Texture> textures_loaded;
+/**
+ * Assimp 网格到交错顶点的批量转换：先按确切大小分配，分支提到循环外。
+ * 有 SSE 时每个顶点拼成两个 16 字节寄存器整体写出，大网格用 streaming
+ * store 绕过缓存（结果马上要上传，读回缓存只会挤掉别的数据）。
+ */
+const unsigned int STREAMING_STORE_VERTICES = 1 << 16;
 
-    /*  函数   */
+void convertVertices(const aiMesh *mesh, vector<Vertex> &vertices) {
+    unsigned int count = mesh->mNumVertices;
+    vertices.resize(count);
+    if (count == 0)
+        return;
+    Vertex *out = vertices.data();
+    const aiVector3D *positions = mesh->mVertices;
+    const aiVector3D *normals = mesh->mNormals;
+    const aiVector3D *uvs = mesh->mTextureCoords[0];
+    unsigned int i = 0;
+#ifdef __SSE2__
+    static_assert(sizeof(Vertex) == 8 * sizeof(float), "Vertex layout changed");
+    if (sizeof(aiVector3D) == 3 * sizeof(float) && ((uintptr_t) out & 15) == 0) {
+        bool streaming = count >= STREAMING_STORE_VERTICES;
+        const float *p = (const float *) positions;
+        const float *n = (const float *) normals;
+        const float *t = (const float *) uvs;
+        __m128 zero = _mm_setzero_ps();
+        // 16 字节的读取会越过最后一个顶点，它留给下面的标量循环
+        for (; i + 1 < count; i++) {
+            __m128 position = _mm_loadu_ps(p + 3 * i);
+            __m128 normal = n ? _mm_loadu_ps(n + 3 * i) : zero;
+            __m128 uv = t ? _mm_loadl_pi(zero, (const __m64 *) (t + 3 * i)) : zero;
+            // (px, py, pz, nx) 与 (ny, nz, u, v)
+            __m128 zx = _mm_shuffle_ps(position, normal, _MM_SHUFFLE(0, 0, 2, 2));
+            __m128 low = _mm_shuffle_ps(position, zx, _MM_SHUFFLE(2, 0, 1, 0));
+            __m128 high = _mm_shuffle_ps(normal, uv, _MM_SHUFFLE(1, 0, 2, 1));
+            float *dst = (float *) (out + i);
+            if (streaming) {
+                _mm_stream_ps(dst, low);
+                _mm_stream_ps(dst + 4, high);
+            } else {
+                _mm_store_ps(dst, low);
+                _mm_store_ps(dst + 4, high);
+            }
+        }
+        if (streaming)
+            _mm_sfence();
+    }
+#endif
+    for (; i < count; i++) {
+        Vertex &vertex = out[i];
+        vertex.Position = glm::vec3(positions[i].x, positions[i].y, positions[i].z);
+        vertex.Normal = normals ? glm::vec3(normals[i].x, normals[i].y, normals[i].z) : glm::vec3(0.0f);
+        // 网格是否有纹理坐标？
+        vertex.TexCoords = uvs ? glm::vec2(uvs[i].x, uvs[i].y) : glm::vec2(0.0f);
+    }
+}
 
-    Model(char *path) {
-        loadModel(path);
+// aiProcess_Triangulate 之后通常全是三角形，直接按 3 个一组拷贝
+void convertIndices(const aiMesh *mesh, vector<unsigned int> &indices) {
+    if (mesh->mPrimitiveTypes == aiPrimitiveType_TRIANGLE) {
+        indices.resize((size_t) mesh->mNumFaces * 3);
+        unsigned int *out = indices.data();
+        for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+            const unsigned int *face = mesh->mFaces[i].mIndices;
+            out[0] = face[0];
+            out[1] = face[1];
+            out[2] = face[2];
+            out += 3;
+        }
+        return;
+    }
+    size_t count = 0;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++)
+        count += mesh->mFaces[i].mNumIndices;
+    indices.clear();
+    indices.reserve(count);
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        const aiFace &face = mesh->mFaces[i];
+        indices.insert(indices.end(), face.mIndices, face.mIndices + face.mNumIndices);
     }
+}
 
-    void draw(Shader shader) {
-        for (auto mesh : meshes)
-            mesh.draw(shader);
+// 拆成每块不超过 maxVertices 个顶点的网格，块内顶点按首次使用排列；
+// 块边界上的顶点会复制。纹理此时还没登记，不用处理
+void splitMeshData(MeshData &data, unsigned int maxVertices, vector<MeshData> &parts) {
+    if (maxVertices < 3 || data.vertices.size() <= maxVertices) {
+        parts.push_back(std::move(data));
+        return;
     }
+    const unsigned int unused = ~0u;
+    vector<unsigned int> remap(data.vertices.size(), unused);
+    // remap 只对 owner 记着的那一块有效
+    vector<unsigned int> owner(data.vertices.size(), unused);
+    unsigned int part = 0;
+    parts.push_back(MeshData());
+    for (size_t t = 0; t + 2 < data.indices.size(); t += 3) {
+        const unsigned int *corners = &data.indices[t];
+        unsigned int added = 0;
+        for (int k = 0; k < 3; k++)
+            if (owner[corners[k]] != part)
+                added++;
+        if (parts.back().vertices.size() + added > maxVertices) {
+            parts.push_back(MeshData());
+            part++;
+        }
+        MeshData &out = parts.back();
+        for (int k = 0; k < 3; k++) {
+            unsigned int v = corners[k];
+            if (owner[v] != part) {
+                owner[v] = part;
+                remap[v] = out.vertices.size();
+                out.vertices.push_back(data.vertices[v]);
+            }
+            out.indices.push_back(remap[v]);
+        }
+    }
+    data = MeshData();
+}
 
-private:
+/**
+ * 用 Assimp 读入模型文件，只产生内存数据，不调用 GL，可以在工作线程里运行。
+ * 纹理只登记成请求，由调用方解码上传后把 id 填回 textures。
+ */
+class ModelImporter {
+public:
+    // 转换网格用的线程池，NULL 时在当前线程完成
+    ThreadPool *pool = NULL;
+    // 按顶点缓存、overdraw 和顶点读取重排，见 mesh_optimize.h
+    bool optimize = MODEL_OPTIMIZE_MESHES;
+    // 顶点多于此数的网格拆开，0 不拆
+    unsigned int splitVertices = MESH_SPLIT_VERTICES;
 
-    /*  函数   */
+    string directory;
+    vector<MeshData> meshes;
+    vector<TextureCache::Request> textureRequests;
+    vector<TextureSlot> textureSlots;
+
+    // 有烘焙文件（见 baked_model.h）就直接读它，跳过 Assimp
+    bool import(const string &path) {
+        string baked = bakedModelPath(path);
+        if (!baked.empty()) {
+            BakedModel model(baked);
+            if (model.ok()) {
+                importBaked(model, path);
+                return true;
+            }
+        }
 
-    void loadModel(string path) {
         Assimp::Importer importer;
         const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs);
 
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) {
             cout << "ERROR::ASSIMP::" << importer.GetErrorString() << endl;
-            return;
+            return false;
         }
         directory = path.substr(0, path.find_last_of('/'));
 
-        processNode(scene->mRootNode, scene);
+        vector<aiMesh*> order;
+        processNode(scene->mRootNode, scene, order);
+        processMeshes(order, scene);
+        return true;
+    }
+
+    // 整块拷贝，不逐顶点处理
+    void importBaked(const BakedModel &model, const string &path) {
+        directory = path.substr(0, path.find_last_of('/'));
+        for (unsigned int i = 0; i < model.meshCount(); i++) {
+            const BakedMesh &baked = model.mesh(i);
+            MeshData data;
+            data.vertices.assign(model.vertices(baked), model.vertices(baked) + baked.vertexCount);
+            data.indices.assign(model.indices(baked), model.indices(baked) + baked.indexCount);
+            data.textures = model.textures(baked);
+            for (size_t t = 0; t < data.textures.size(); t++) {
+                textureRequests.push_back(materialTextureRequest(data.textures[t], directory));
+                textureSlots.push_back(TextureSlot{meshes.size(), t});
+            }
+            meshes.push_back(std::move(data));
+        }
     }
 
-    void processNode(aiNode *node, const aiScene *scene, int layerCnt = 0) {
+private:
+
+    // 按节点顺序收集网格，之后统一转换
+    void processNode(aiNode *node, const aiScene *scene, vector<aiMesh*> &order, int layerCnt = 0) {
+#ifdef PRINT_NODE
         // 打印Node名称
         for (int i = 0; i < layerCnt; i++)
             std::cout << " -";
-        std::cout << " " << node->mName.C_Str() << std::endl;
+        std::cout << " " << node->mName.C_Str() << ", num = " << node->mNumMeshes << std::endl;
+#endif
         // 处理节点所有的网格（如果有的话）
-        for(int i = 0; i < node->mNumMeshes; i++) {
-            aiMesh *mesh = scene->mMeshes[node->mMeshes[i]]; 
-            meshes.push_back(processMesh(mesh, scene));         
-        }
+        for(unsigned int i = 0; i < node->mNumMeshes; i++)
+            order.push_back(scene->mMeshes[node->mMeshes[i]]);
         // 接下来对它的子节点重复这一过程
-        for(int i = 0; i < node->mNumChildren; i++) {
-            processNode(node->mChildren[i], scene, layerCnt + 1);
+        for(unsigned int i = 0; i < node->mNumChildren; i++) {
+            processNode(node->mChildren[i], scene, order, layerCnt + 1);
         }
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene) {
-        vector<Vertex> vertices;
-        vector<unsigned int> indices;
-        vector<Texture> textures;
-
-        for (int i = 0; i < mesh->mNumVertices; i++) {
-            Vertex vertex;
-            glm::vec3 vector; 
-            // Vertex
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z; 
-            vertex.Position = vector;
-            // Normal
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // Texture
-            if(mesh->mTextureCoords[0]) { // 网格是否有纹理坐标？
-                glm::vec2 vec;
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            } else {
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+    // 顶点和索引在 pool 上按网格并行转换（大网格同时拆开），材质按顺序登记
+    void processMeshes(const vector<aiMesh*> &order, const aiScene *scene) {
+        vector<vector<MeshData>> parts(order.size());
+        auto convert = [&](size_t i) {
+            MeshData data;
+            convertVertices(order[i], data.vertices);
+            convertIndices(order[i], data.indices);
+            if (optimize)
+                optimizeMesh(data.vertices, data.indices);
+            splitMeshData(data, splitVertices, parts[i]);
+        };
+        if (pool)
+            pool->parallelFor(order.size(), convert);
+        else
+            for (size_t i = 0; i < order.size(); i++)
+                convert(i);
+        for (size_t i = 0; i < order.size(); i++) {
+            for (MeshData &part : parts[i]) {
+                meshes.push_back(std::move(part));
+                processMesh(order[i], scene, meshes.size() - 1);
             }
-            vertices.push_back(vertex);
-        }
-        // 处理索引
-        for(int i = 0; i < mesh->mNumFaces; i++) {
-            aiFace face = mesh->mFaces[i];
-            for(int j = 0; j < face.mNumIndices; j++)
-                indices.push_back(face.mIndices[j]);
         }
+    }
+
+    void processMesh(aiMesh *mesh, const aiScene *scene, size_t index) {
+#ifdef PRINT_MESH
+        std::cout << " :- mesh: " << mesh->mName.C_Str() << std::endl;
+#endif
         // 处理材质
         if (mesh->mMaterialIndex >= 0) {
             aiMaterial *material = scene->mMaterials[mesh->mMaterialIndex];
             // diffuse maps
-            vector<Texture> diffuseMaps = loadMaterialTextures(material, 
-                                                aiTextureType_DIFFUSE, "texture_diffuse");
-            textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
+            loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", index);
             // specular maps
-            vector<Texture> specularMaps = loadMaterialTextures(material, 
-                                                aiTextureType_SPECULAR, "texture_specular");
-            textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+            loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular", index);
         }
-
-        return Mesh(vertices, indices, textures);
     }
 
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, 
-                                            string typeName) {
-        vector<Texture> textures;
-        for(int i = 0; i < mat->GetTextureCount(type); i++) {
+    // 只登记请求，纹理 id 由调用方填入
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName, size_t mesh) {
+        vector<Texture> &textures = meshes[mesh].textures;
+        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++) {
             aiString str;
             mat->GetTexture(type, i, &str);
-            bool skip = false;
-            for (auto cache : textures_loaded) {
-                if (std::strcmp(cache.path.C_Str(), str.C_Str()) == 0) {
-                    textures.push_back(cache);
-                    skip = true; 
-                    break;
-                }
+            // 同一图片只解码一次，由 textureCache() 去重
+            Texture texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str;
+            textureRequests.push_back(materialTextureRequest(texture, directory));
+            textureSlots.push_back(TextureSlot{mesh, textures.size()});
+            textures.push_back(texture);
+        }
+    }
+};
+
+class Model {
+public:
+
+    /*  模型数据  */
+
+    vector<Mesh> meshes;
+    string directory;
+
+    /*  函数   */
+
+    // keepCpuData = false 只在显存里保留网格，需要时用 Mesh::readVertices() 读回
+    // 纹理在 pool 上并行解码，pool = NULL 时在当前线程依次解码
+    // optimizeMeshes = false 跳过导入时的网格重排（烘焙文件已经排好，不受影响）
+    // vertexFormat = VERTEX_PACKED 显存里每个顶点 16 字节，着色器要定义 PACKED_VERTICES
+    // arena = NULL 时每个网格独占自己的缓冲和 VAO
+    Model(char *path, bool keepCpuData = MODEL_KEEP_CPU_DATA, ThreadPool *pool = &threadPool(),
+          bool optimizeMeshes = MODEL_OPTIMIZE_MESHES, VertexFormat vertexFormat = VERTEX_FLOAT,
+          GeometryArena *arena = defaultGeometryArena())
+        : keepCpuData(keepCpuData), pool(pool), optimizeMeshes(optimizeMeshes), vertexFormat(vertexFormat),
+          arena(arena) {
+        loadModel(path);
+    }
+
+    // 网格持有 GPU 资源，模型同样不可拷贝
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
+    // 纹理在 textureCache() 中与其他模型共享，这里只归还引用
+    ~Model() {
+        for (const Mesh &mesh : meshes)
+            for (const Texture &texture : mesh.textures)
+                textureCache().release(texture.id);
+    }
+
+    // 同一 arena 块里的网格共用 VAO，只在换块时绑定
+    void draw(const Shader &shader) const {
+        drawVisible(shader, NULL);
+    }
+
+    // frustum 由 projection * view * model 构造，包围盒完全在视锥外的网格不画
+    void draw(const Shader &shader, const Frustum &frustum) const {
+        drawVisible(shader, cull(frustum));
+    }
+
+    // pick the variant matching each mesh's textures (HAS_SPECULAR_MAP),
+    // switching programs only when it changes
+    void draw(ShaderVariants &variants, const ShaderDefines &defines) const {
+        draw(variants.get(ShaderDefines(defines).set("HAS_SPECULAR_MAP", 1)),
+             variants.get(ShaderDefines(defines).set("HAS_SPECULAR_MAP", 0)));
+    }
+
+    // same with both variants looked up beforehand, nothing is allocated
+    void draw(const Shader &withSpecular, const Shader &withoutSpecular) const {
+        drawVisible(withSpecular, withoutSpecular, NULL);
+    }
+
+    void draw(const Shader &withSpecular, const Shader &withoutSpecular, const Frustum &frustum) const {
+        drawVisible(withSpecular, withoutSpecular, cull(frustum));
+    }
+
+    // 同样的绘制，连续的同状态网格合成一次 glMultiDrawElementsIndirect，见 indirect_draw.h
+    // 网格数变了（ModelHandle 又放入了网格）才重建命令
+    void drawIndirect(const Shader &shader) const {
+        drawIndirect(shader, shader);
+    }
+
+    void drawIndirect(const Shader &withSpecular, const Shader &withoutSpecular) const {
+        drawIndirectVisible(withSpecular, withoutSpecular, NULL);
+    }
+
+    // 被剔除的网格命令里实例数为 0
+    void drawIndirect(const Shader &withSpecular, const Shader &withoutSpecular, const Frustum &frustum) const {
+        drawIndirectVisible(withSpecular, withoutSpecular, cull(frustum));
+    }
+
+    // 内存中仍保留的顶点和索引数据
+    size_t cpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.cpuBytes();
+        return bytes;
+    }
+
+    // 顶点和索引缓冲的大小
+    size_t gpuBytes() const {
+        size_t bytes = 0;
+        for (const Mesh &mesh : meshes)
+            bytes += mesh.bufferBytes();
+        return bytes;
+    }
+
+private:
+
+    bool keepCpuData;
+    ThreadPool *pool;
+    bool optimizeMeshes;
+    VertexFormat vertexFormat;
+    GeometryArena *arena;
+    mutable IndirectDrawList drawList;
+    // 各网格的包围盒和最近一次剔除的结果，下标与 meshes 相同
+    mutable CullBoxes cullBoxes;
+    mutable vector<unsigned char> visibility;
+
+    friend class ModelHandle;
+
+    // 空模型，由 ModelHandle 逐个放入已上传好的网格
+    Model(const string &directory, bool keepCpuData, VertexFormat vertexFormat, GeometryArena *arena)
+        : directory(directory), keepCpuData(keepCpuData), pool(NULL), optimizeMeshes(false),
+          vertexFormat(vertexFormat), arena(arena) {
+    }
+
+    /*  函数   */
+
+    // 新放入的网格先补上包围盒；返回每个网格是否可见，并计入 meshDrawStats
+    const unsigned char *cull(const Frustum &frustum) const {
+        for (size_t i = cullBoxes.size(); i < meshes.size(); i++)
+            cullBoxes.add(meshes[i].boundsMin, meshes[i].boundsMax);
+        visibility.resize(meshes.size());
+        size_t visible = cullBoxes.cull(frustum, visibility.data());
+        meshDrawStats.meshesVisible += visible;
+        meshDrawStats.meshesCulled += meshes.size() - visible;
+        return visibility.data();
+    }
+
+    // visible 为 NULL 时全部绘制
+    void drawVisible(const Shader &shader, const unsigned char *visible) const {
+        GLuint boundVertexArray = 0;
+        for (size_t i = 0; i < meshes.size(); i++)
+            if (!visible || visible[i])
+                meshes[i].draw(shader, boundVertexArray);
+        glBindVertexArray(0);
+        meshDrawStats.vertexArrayBinds++;
+    }
+
+    void drawVisible(const Shader &withSpecular, const Shader &withoutSpecular, const unsigned char *visible) const {
+        const Shader *current = NULL;
+        GLuint boundVertexArray = 0;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            if (visible && !visible[i])
+                continue;
+            const Mesh &mesh = meshes[i];
+            const Shader &shader = mesh.hasTexture("texture_specular") ? withSpecular : withoutSpecular;
+            if (&shader != current) {
+                glUseProgram(shader.ID);
+                current = &shader;
             }
-            if (!skip) {
-                Texture texture;
-                texture.id = textureFromFile(str.C_Str(), directory);
-                texture.type = typeName;
-                texture.path = str;
-                textures.push_back(texture);
+            mesh.draw(shader, boundVertexArray);
+        }
+        glBindVertexArray(0);
+        meshDrawStats.vertexArrayBinds++;
+    }
+
+    void drawIndirectVisible(const Shader &withSpecular, const Shader &withoutSpecular,
+                             const unsigned char *visible) const {
+        if (drawList.meshCount() != meshes.size())
+            drawList.build(meshes);
+        drawList.draw(meshes, withSpecular, withoutSpecular, visible);
+    }
+
+    void loadModel(string path) {
+        string baked = bakedModelPath(path);
+        if (!baked.empty() && loadBaked(baked, path))
+            return;
+
+        ModelImporter importer;
+        importer.pool = pool;
+        importer.optimize = optimizeMeshes;
+        if (!importer.import(path))
+            return;
+        directory = importer.directory;
+
+        // 逐个建网格，不保留内存数据时建完就释放
+        meshes.reserve(importer.meshes.size());
+        for (MeshData &data : importer.meshes) {
+            meshes.push_back(Mesh(std::move(data.vertices), std::move(data.indices), std::move(data.textures),
+                                  vertexFormat, arena));
+            if (!keepCpuData)
+                meshes.back().releaseCpuData();
+        }
+        loadTextures(importer.textureRequests, importer.textureSlots);
+    }
+
+    // 缓冲直接从映射的文件上传
+    bool loadBaked(const string &baked, const string &path) {
+        BakedModel model(baked);
+        if (!model.ok())
+            return false;
+        directory = path.substr(0, path.find_last_of('/'));
+        vector<TextureCache::Request> requests;
+        vector<TextureSlot> slots;
+        meshes.reserve(model.meshCount());
+        for (unsigned int i = 0; i < model.meshCount(); i++) {
+            const BakedMesh &mesh = model.mesh(i);
+            vector<Texture> textures = model.textures(mesh);
+            for (size_t t = 0; t < textures.size(); t++) {
+                requests.push_back(materialTextureRequest(textures[t], directory));
+                slots.push_back(TextureSlot{meshes.size(), t});
             }
+            meshes.push_back(Mesh(model.vertices(mesh), mesh.vertexCount, model.indices(mesh), mesh.indexCount,
+                                  std::move(textures),
+                                  glm::vec3(mesh.boundsMin[0], mesh.boundsMin[1], mesh.boundsMin[2]),
+                                  glm::vec3(mesh.boundsMax[0], mesh.boundsMax[1], mesh.boundsMax[2]),
+                                  keepCpuData, vertexFormat, arena));
         }
-        return textures;
+        loadTextures(requests, slots);
+        return true;
+    }
+
+    // 所有图片一起并行解码，再按材质顺序在当前（GL）线程上传
+    void loadTextures(const vector<TextureCache::Request> &requests, const vector<TextureSlot> &slots) {
+        vector<unsigned int> ids = textureCache().acquire(requests, pool);
+        for (size_t i = 0; i < ids.size(); i++)
+            meshes[slots[i].mesh].textures[slots[i].texture].id = ids[i];
     }
 };
 
 unsigned int textureFromFile(string filepath, string directory) {
+    return loadTexture(texturePath(filepath, directory));
+}
+
+string texturePath(string filepath, string directory) {
     int pos = 0;
     // Win路径修正
     while ((pos = filepath.find("\\")) >= 0) {
         filepath.replace(pos, 1, "/");
     }
-    filepath = directory + "/" + filepath;
-    return loadTexture(filepath);
+    return directory + "/" + filepath;
 }
 
+// 材质里记的相对路径换成 textureCache() 的请求
+TextureCache::Request materialTextureRequest(const Texture &texture, const string &directory) {
+    TextureCache::Request request;
+    request.path = texturePath(texture.path.C_Str(), directory);
+    return request;
+}
+
+// 经过 textureCache()，同一文件和参数只加载一次
 unsigned int loadTexture(string filepath, int warp_s, int warp_t, bool gammaCorrection) {
-    unsigned int texture = 0;
-    std::cout << "Start loading texture: " << filepath << std::endl;
-    // Create texture
-    glGenTextures(1, &texture);
-    // Load and generate texture
-    int width, height, nrChannels;
-    // stbi_set_flip_vertically_on_load(true);
-    unsigned char *data = stbi_load(filepath.c_str(), &width, &height, &nrChannels, 0);
-    GLenum mode;
-    GLenum internal;
-    if (data) {
-        if (nrChannels == 1) {
-            internal = mode = GL_RED;
-        } else if (nrChannels == 3) {
-            internal = gammaCorrection ? GL_SRGB : GL_RGB;
-            mode = GL_RGB;
-        } else if (nrChannels == 4) {
-            internal = gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
-            mode = GL_RGBA;
-            // std::cout << "Alpha enabled for: " << filepath << std::endl;
-        }
-        // std::cout << nrChannels << std::endl;
-        glBindTexture(GL_TEXTURE_2D, texture);
-        // Load data
-        glTexImage2D(GL_TEXTURE_2D, 0, internal, width, height, 0, mode, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-        // Configure wrap and filter type
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, warp_s);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, warp_t);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    } else {
-        std::cout << "Failed to load texture" << std::endl;
-    }
-    // Free image
-    stbi_image_free(data);
-    return texture;
+    return textureCache().acquire(filepath, warp_s, warp_t, gammaCorrection);
 }
 
 unsigned int loadCubemap(vector<std::string> faces) {
@@ -209,7 +580,7 @@ unsigned int loadCubemap(vector<std::string> faces) {
     std::cout << "Start loading cubemap: " << faces[0] << ", ..." << std::endl;
 
     int width, height, nrChannels;
-    for (int i = 0; i < faces.size(); i++) {
+    for (size_t i = 0; i < faces.size(); i++) {
         unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
         if (data) {
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 
@@ -0,0 +1,411 @@
+#ifndef MODEL_STREAM_H
+#define MODEL_STREAM_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "model.h"
+#include "texture_cache.h"
+#include "thread_pool.h"
+
+/**
+ * A Model that loads in the background while the scene keeps rendering.
+ *
+ * The Assimp import runs on a ThreadPool worker and the textures are
+ * decoded there too. update(), called once per frame on the GL thread,
+ * then uploads at most `frameBudget` bytes: texture rows through a pixel
+ * unpack buffer, vertex and index data with Mesh::uploadChunk(). Meshes
+ * are finished in file order, each once its textures are complete, and
+ * only finished meshes are drawn. forEachPlaceholder() reports the bounds
+ * of the rest so the scene can show something in their place.
+ *
+ *     ModelHandle *handle = new ModelHandle("model/rin/Black.pmx");
+ *     // every frame
+ *     handle->update();
+ *     handle->draw(withSpecular, withoutSpecular);
+ *     handle->forEachPlaceholder([&](const glm::vec3 &min, const glm::vec3 &max) { ... });
+ */
+class ModelHandle {
+public:
+    // what the last update() did
+    struct FrameStats {
+        size_t bytes = 0;
+        double ms = 0.0;
+    };
+
+    FrameStats lastFrame;
+
+    ModelHandle(const std::string &path, size_t frameBudget = 4 << 20,
+                bool keepCpuData = MODEL_KEEP_CPU_DATA, ThreadPool *pool = &threadPool(),
+                bool optimizeMeshes = MODEL_OPTIMIZE_MESHES, VertexFormat vertexFormat = VERTEX_FLOAT,
+                GeometryArena *arena = defaultGeometryArena())
+        : frameBudget(std::max(frameBudget, (size_t) 1)), keepCpuData(keepCpuData), pool(pool),
+          vertexFormat(vertexFormat), arena(arena)
+    {
+        start = std::chrono::steady_clock::now();
+        importing = pool->submit([path, pool, optimizeMeshes] {
+            return importModel(path, pool, optimizeMeshes);
+        });
+    }
+
+    ModelHandle(const ModelHandle &) = delete;
+    ModelHandle &operator=(const ModelHandle &) = delete;
+
+    ~ModelHandle() {
+        // nothing can be cancelled, wait for the jobs still holding our data
+        if (importing.valid())
+            importing.wait();
+        for (std::future<TextureCache::Image> &image : images) {
+            if (image.valid())
+                stbi_image_free(image.get().data);
+        }
+        if (texture.id) {
+            glDeleteTextures(1, &texture.id);
+            stbi_image_free(texture.image.data);
+        }
+        // references taken for meshes that never made it into the model
+        if (model && source) {
+            for (size_t i = 0; i < textureIds.size(); i++)
+                if (textureIds[i] && source->textureSlots[i].mesh >= model->meshes.size())
+                    textureCache().release(textureIds[i]);
+        }
+        uploading.reset();
+        model.reset();
+        if (pbo)
+            glDeleteBuffers(1, &pbo);
+    }
+
+    // call once per frame, before drawing
+    void update() {
+        auto frameStart = std::chrono::steady_clock::now();
+        lastFrame = FrameStats();
+        if (importing.valid()) {
+            if (importing.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+                return;
+            imported(importing.get());
+        }
+        if (!model || ready())
+            return;
+
+        size_t spent = 0;
+        while (spent < frameBudget && !ready()) {
+            size_t bytes = step(frameBudget - spent);
+            if (bytes == 0)
+                break;
+            spent += bytes;
+        }
+        lastFrame.bytes = spent;
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frameStart;
+        lastFrame.ms = elapsed.count();
+
+        if (ready()) {
+            std::chrono::duration<double, std::milli> total = std::chrono::steady_clock::now() - start;
+            std::cout << "ModelHandle: " << model->meshes.size() << " meshes streamed in "
+                      << total.count() << " ms" << std::endl;
+            source.reset();
+        }
+    }
+
+    // blocks until every mesh is uploaded, like constructing a Model does
+    void finish() {
+        size_t budget = frameBudget;
+        frameBudget = (size_t) -1;
+        blocking = true;
+        if (importing.valid())
+            importing.wait();
+        update();
+        frameBudget = budget;
+        blocking = false;
+    }
+
+    bool failed() const {
+        return loadFailed;
+    }
+
+    // every mesh is uploaded and drawn
+    bool ready() const {
+        return model && model->meshes.size() == meshCount;
+    }
+
+    size_t readyMeshes() const {
+        return model ? model->meshes.size() : 0;
+    }
+
+    // 0 until the import is done
+    size_t totalMeshes() const {
+        return meshCount;
+    }
+
+    // NULL until the import is done, then holds the finished meshes
+    const Model *get() const {
+        return model.get();
+    }
+
+    void draw(const Shader &shader) const {
+        if (model)
+            model->draw(shader);
+    }
+
+    void draw(const Shader &withSpecular, const Shader &withoutSpecular) const {
+        if (model)
+            model->draw(withSpecular, withoutSpecular);
+    }
+
+    void drawIndirect(const Shader &shader) const {
+        if (model)
+            model->drawIndirect(shader);
+    }
+
+    void drawIndirect(const Shader &withSpecular, const Shader &withoutSpecular) const {
+        if (model)
+            model->drawIndirect(withSpecular, withoutSpecular);
+    }
+
+    // frustum from projection * view * model, see Model::draw
+    void draw(const Shader &withSpecular, const Shader &withoutSpecular, const Frustum &frustum) const {
+        if (model)
+            model->draw(withSpecular, withoutSpecular, frustum);
+    }
+
+    void drawIndirect(const Shader &withSpecular, const Shader &withoutSpecular, const Frustum &frustum) const {
+        if (model)
+            model->drawIndirect(withSpecular, withoutSpecular, frustum);
+    }
+
+    // fn(boundsMin, boundsMax) for every mesh not drawn yet
+    template <typename F>
+    void forEachPlaceholder(F &&fn) const {
+        if (!model || !source)
+            return;
+        for (size_t i = model->meshes.size(); i < meshCount; i++)
+            fn(source->boundsMin[i], source->boundsMax[i]);
+    }
+
+private:
+    // ModelImporter plus the bounds placeholders need before the Mesh exists
+    struct Import : ModelImporter {
+        bool loaded = false;
+        vector<glm::vec3> boundsMin;
+        vector<glm::vec3> boundsMax;
+    };
+
+    // one texture being copied into GL a few rows at a time
+    struct TextureUpload {
+        unsigned int id = 0;
+        TextureCache::Image image;
+        GLenum internal, mode;
+        int rowsDone = 0;
+    };
+
+    size_t frameBudget;
+    bool keepCpuData;
+    ThreadPool *pool;
+    VertexFormat vertexFormat;
+    GeometryArena *arena;
+    std::chrono::steady_clock::time_point start;
+
+    std::future<std::unique_ptr<Import>> importing;
+    std::unique_ptr<Import> source;
+    std::unique_ptr<Model> model;
+    size_t meshCount = 0;
+    bool loadFailed = false;
+    bool blocking = false;
+
+    // per texture request
+    std::vector<std::string> textureKeys;
+    std::vector<std::future<TextureCache::Image>> images;
+    std::vector<unsigned int> textureIds;
+    size_t nextRequest = 0;
+    TextureUpload texture;
+
+    std::unique_ptr<Mesh> uploading;
+    GLuint pbo = 0;
+
+    // runs on a worker thread, no GL
+    static std::unique_ptr<Import> importModel(const std::string &path, ThreadPool *pool, bool optimize) {
+        std::unique_ptr<Import> result(new Import());
+        result->pool = pool;
+        result->optimize = optimize;
+        result->loaded = result->import(path);
+        for (const MeshData &mesh : result->meshes) {
+            glm::vec3 min(0.0f), max(0.0f);
+            if (!mesh.vertices.empty()) {
+                min = max = mesh.vertices[0].Position;
+                for (const Vertex &vertex : mesh.vertices) {
+                    min = glm::min(min, vertex.Position);
+                    max = glm::max(max, vertex.Position);
+                }
+            }
+            result->boundsMin.push_back(min);
+            result->boundsMax.push_back(max);
+        }
+        return result;
+    }
+
+    void imported(std::unique_ptr<Import> result) {
+        source = std::move(result);
+        if (!source->loaded) {
+            loadFailed = true;
+            source.reset();
+            return;
+        }
+        model.reset(new Model(source->directory, keepCpuData, vertexFormat, arena));
+        model->meshes.reserve(source->meshes.size());
+        meshCount = source->meshes.size();
+
+        // start decoding every texture not loaded yet, each file once
+        const vector<TextureCache::Request> &requests = source->textureRequests;
+        textureIds.assign(requests.size(), 0);
+        images.resize(requests.size());
+        std::unordered_set<std::string> submitted;
+        for (size_t i = 0; i < requests.size(); i++) {
+            textureKeys.push_back(TextureCache::key(requests[i]));
+#ifndef TEXTURE_NO_CACHE
+            unsigned int id;
+            if (!submitted.insert(textureKeys[i]).second)
+                continue;
+            if (textureCache().find(textureKeys[i], id)) {
+                // taken now so it cannot go away before the mesh needs it
+                textureIds[i] = id;
+                continue;
+            }
+#endif
+            images[i] = decodeLater(requests[i].path);
+        }
+    }
+
+    std::future<TextureCache::Image> decodeLater(const std::string &path) {
+        return pool->submit([path] { return TextureCache::decode(path); });
+    }
+
+    // one piece of work for the next unfinished mesh; 0 when it has to wait
+    size_t step(size_t budget) {
+        size_t mesh = model->meshes.size();
+        const vector<TextureCache::Request> &requests = source->textureRequests;
+        const vector<TextureSlot> &slots = source->textureSlots;
+
+        // 1. the mesh's textures
+        if (nextRequest < requests.size() && slots[nextRequest].mesh == mesh) {
+            if (!textureIds[nextRequest] && !texture.id && !beginTexture(nextRequest))
+                return 0;
+            size_t bytes = texture.id ? uploadRows(budget) : 0;
+            if (!texture.id)
+                nextRequest++;
+            // an already loaded texture costs nothing, but keep going
+            return std::max(bytes, (size_t) 1);
+        }
+
+        // 2. its buffers
+        if (!uploading) {
+            MeshData &data = source->meshes[mesh];
+            for (size_t i = nextRequestOf(mesh); i < nextRequest; i++)
+                data.textures[slots[i].texture].id = textureIds[i];
+            uploading.reset(new Mesh(std::move(data.vertices), std::move(data.indices),
+                                     std::move(data.textures), Mesh::Deferred(), vertexFormat, arena));
+        }
+        size_t bytes = uploading->uploadChunk(budget);
+        if (uploading->uploaded()) {
+            if (!keepCpuData)
+                uploading->releaseCpuData();
+            model->meshes.push_back(std::move(*uploading));
+            uploading.reset();
+        }
+        return std::max(bytes, (size_t) 1);
+    }
+
+    size_t nextRequestOf(size_t mesh) const {
+        size_t i = nextRequest;
+        while (i > 0 && source->textureSlots[i - 1].mesh == mesh)
+            i--;
+        return i;
+    }
+
+    // false while the pixels are still being decoded
+    bool beginTexture(size_t request) {
+        unsigned int id;
+        if (textureCache().find(textureKeys[request], id)) {
+            textureIds[request] = id;
+            return true;
+        }
+        // a duplicate, or released since the import: decode it now
+        if (!images[request].valid())
+            images[request] = decodeLater(source->textureRequests[request].path);
+        if (!blocking && images[request].wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+
+        const TextureCache::Request &info = source->textureRequests[request];
+        texture = TextureUpload();
+        texture.image = images[request].get();
+        std::cout << "Start streaming texture: " << info.path << std::endl;
+        glGenTextures(1, &texture.id);
+        if (!texture.image.data) {
+            std::cout << "Failed to load texture" << std::endl;
+            finishTexture(request);
+            return true;
+        }
+        // storage only, the rows follow through the unpack buffer
+        TextureCache::pixelFormat(info, texture.image.nrChannels, texture.internal, texture.mode);
+        glBindTexture(GL_TEXTURE_2D, texture.id);
+        glTexImage2D(GL_TEXTURE_2D, 0, texture.internal, texture.image.width, texture.image.height,
+                     0, texture.mode, GL_UNSIGNED_BYTE, NULL);
+        return true;
+    }
+
+    size_t uploadRows(size_t budget) {
+        const TextureCache::Image &image = texture.image;
+        size_t rowBytes = (size_t) image.width * image.nrChannels;
+        int rows = (int) std::min((size_t) (image.height - texture.rowsDone),
+                                  std::max(budget / rowBytes, (size_t) 1));
+        size_t size = rows * rowBytes;
+
+        if (!pbo)
+            glGenBuffers(1, &pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        // orphan the old storage instead of waiting for the driver to read it
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size,
+                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (dst) {
+            std::memcpy(dst, image.data + texture.rowsDone * rowBytes, size);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glBindTexture(GL_TEXTURE_2D, texture.id);
+            // stb_image rows are tightly packed
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, texture.rowsDone, image.width, rows,
+                            texture.mode, GL_UNSIGNED_BYTE, (void *) 0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        texture.rowsDone += rows;
+        if (texture.rowsDone == image.height) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+            const TextureCache::Request &info = source->textureRequests[nextRequest];
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, info.wrapS);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, info.wrapT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            finishTexture(nextRequest);
+        }
+        return size;
+    }
+
+    // hand the texture to the cache, where later requests find it
+    void finishTexture(size_t request) {
+        textureCache().adopt(textureKeys[request], texture.id, texture.image);
+        textureIds[request] = texture.id;
+        stbi_image_free(texture.image.data);
+        texture = TextureUpload();
+    }
+};
+
+#endif
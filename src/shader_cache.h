@@ -0,0 +1,167 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "gl_ext.h"
+#include "shader_source.h"
+
+/**
+ * On-disk cache of linked program binaries.
+ *
+ * A program is keyed by a hash of its stage sources and transform feedback
+ * varyings plus the driver's vendor/renderer/version strings, so a driver
+ * update simply misses.
+ * Every blob starts with a small header; a file that does not match it,
+ * or whose size disagrees with it, is a miss and the caller compiles from
+ * source as usual. A binary the driver refuses in glProgramBinary is
+ * reported apart, as it leaves the program unusable. Blobs are written to
+ * a temporary file and renamed into place, so a crash or another process
+ * never leaves a truncated one under a key.
+ */
+class ProgramBinaryCache {
+public:
+    std::string directory;
+
+    enum LoadResult {
+        MISS,     // no usable file, the program is untouched
+        LOADED,
+        REJECTED  // the driver refused the binary, create the program again
+    };
+
+    ProgramBinaryCache(const std::string &dir = ".shader_cache") : directory(dir) {}
+
+    bool enabled() {
+        return glExt().programBinary;
+    }
+
+    // FNV-1a over the driver strings, every (type, source pieces) pair and the varyings
+    uint64_t key(const std::vector<GLenum> &types, const std::vector<ShaderPieces> &sources,
+                 const std::vector<std::string> &varyings = {}) {
+        uint64_t hash = 1469598103934665603ULL;
+        hash = hashString(hash, (const char *) glGetString(GL_VENDOR));
+        hash = hashString(hash, (const char *) glGetString(GL_RENDERER));
+        hash = hashString(hash, (const char *) glGetString(GL_VERSION));
+        for (size_t i = 0; i < sources.size(); i++) {
+            hash = hashBytes(hash, &types[i], sizeof(GLenum));
+            const ShaderPieces &pieces = sources[i];
+            for (size_t j = 0; j < pieces.strings.size(); j++) {
+                uint64_t size = pieces.lengths[j];
+                hash = hashBytes(hash, &size, sizeof(size));
+                hash = hashBytes(hash, pieces.strings[j], pieces.lengths[j]);
+            }
+        }
+        // captured varyings are part of the link, with the same sources or not
+        for (const std::string &varying : varyings) {
+            uint64_t size = varying.size();
+            hash = hashBytes(hash, &size, sizeof(size));
+            hash = hashBytes(hash, varying.data(), varying.size());
+        }
+        return hash;
+    }
+
+    // must be set before glLinkProgram for the binary to be retrievable
+    void prepare(GLuint program) {
+        if (enabled())
+            glExt().programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    LoadResult load(uint64_t key, GLuint program) {
+        if (!enabled())
+            return MISS;
+        FILE *file = fopen(path(key).c_str(), "rb");
+        if (!file)
+            return MISS;
+        Header header;
+        std::vector<char> blob;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1
+                  && header.magic == MAGIC && header.key == key && header.length > 0;
+        // the length comes from disk, so it must account for the rest of the file exactly
+        if (ok) {
+            ok = fseek(file, 0, SEEK_END) == 0
+                 && ftell(file) == (long) (sizeof(header) + (size_t) header.length)
+                 && fseek(file, sizeof(header), SEEK_SET) == 0;
+        }
+        if (ok) {
+            blob.resize(header.length);
+            ok = fread(blob.data(), 1, blob.size(), file) == blob.size();
+        }
+        fclose(file);
+        if (!ok)
+            return MISS;
+        glExt().programBinaryLoad(program, header.format, blob.data(), header.length);
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        return success ? LOADED : REJECTED;
+    }
+
+    void store(uint64_t key, GLuint program) {
+        if (!enabled())
+            return;
+        GLint length = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        Header header;
+        header.magic = MAGIC;
+        header.key = key;
+        std::vector<char> blob(length);
+        glExt().getProgramBinary(program, length, &header.length, &header.format, blob.data());
+        mkdir(directory.c_str(), 0755);
+        // one temporary file per process, renamed over the key once complete
+        std::string target = path(key);
+        std::string temporary = target + "." + std::to_string(getpid()) + ".tmp";
+        FILE *file = fopen(temporary.c_str(), "wb");
+        if (!file)
+            return;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+                  && fwrite(blob.data(), 1, header.length, file) == (size_t) header.length;
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(temporary.c_str(), target.c_str()) != 0)
+            remove(temporary.c_str());
+    }
+
+private:
+    static const uint32_t MAGIC = 0x4e494250; // "PBIN"
+
+    struct Header {
+        uint32_t magic;
+        GLenum format;
+        uint64_t key;
+        GLsizei length;
+    };
+
+    std::string path(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long) key);
+        return directory + name;
+    }
+
+    static uint64_t hashBytes(uint64_t hash, const void *data, size_t size) {
+        const unsigned char *bytes = (const unsigned char *) data;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static uint64_t hashString(uint64_t hash, const char *str) {
+        // keep the terminator so "ab" + "c" differs from "a" + "bc"
+        return str ? hashBytes(hash, str, strlen(str) + 1) : hash;
+    }
+};
+
+ProgramBinaryCache &programBinaryCache() {
+    static ProgramBinaryCache cache;
+    return cache;
+}
+
+#endif
@@ -0,0 +1,343 @@
+#ifndef SHADER_RELOAD_H
+#define SHADER_RELOAD_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "shader_s.h"
+
+/**
+ * Rebuilds programs whose source files (or their #includes) change on disk.
+ *
+ * Every finished Shader registers itself. update(), called at the start of
+ * each frame, drains an inotify descriptor without blocking, submits a new
+ * program for each affected shader and swaps it in once it has linked.
+ * Until then the old program keeps drawing, and it stays when the new one
+ * fails. Uniform values and block bindings carry over, so samplers set
+ * once at startup survive a reload.
+ *
+ * A rebuild is submitted in one frame and its status is not asked for
+ * before the next, so the compile always has a frame to itself. With
+ * KHR_parallel_shader_compile the driver compiles in the background and a
+ * frame only pays for the submit and the swap. Without it the status query
+ * waits for whatever the compiler has left, which is nothing when the
+ * driver compiles on threads of its own; only one program is rebuilt at a
+ * time then. The longest time update() spent in a frame while reloading,
+ * i.e. the hitch, is printed when the reload is done, split into the
+ * submitting and the swapping frames.
+ *
+ * Build with -DSHADER_NO_HOT_RELOAD to turn it off.
+ */
+class ShaderReloader {
+public:
+    ~ShaderReloader() {
+        if (fd >= 0)
+            close(fd);
+    }
+
+    void watch(Shader *shader) {
+        if (!start())
+            return;
+        if (std::find(shaders.begin(), shaders.end(), shader) == shaders.end())
+            shaders.push_back(shader);
+        for (const std::string &path : shader->dependencies)
+            watchDirectory(path);
+    }
+
+    void unwatch(Shader *shader) {
+        // replacements being built are not watched
+        if (!shader->hotReload)
+            return;
+        shaders.erase(std::remove(shaders.begin(), shaders.end(), shader), shaders.end());
+        queued.erase(std::remove(queued.begin(), queued.end(), shader), queued.end());
+        for (size_t i = 0; i < reloads.size(); i++) {
+            if (reloads[i].target == shader) {
+                discard(reloads[i]);
+                reloads.erase(reloads.begin() + i);
+                break;
+            }
+        }
+    }
+
+    // call once per frame, before drawing
+    void update() {
+        if (fd < 0)
+            return;
+        auto frameStart = std::chrono::steady_clock::now();
+        frame++;
+        readEvents();
+        if (queued.empty() && reloads.empty())
+            return;
+
+        // 1. submit the rebuilds, one at a time when finishing one blocks
+        bool parallel = glExt().parallelShaderCompile;
+        while (!queued.empty() && (parallel || reloads.empty())) {
+            Shader *target = queued.front();
+            queued.erase(queued.begin());
+            submit(target);
+        }
+        auto submitEnd = std::chrono::steady_clock::now();
+
+        // 2. swap in whatever the driver has finished, from the frame after the submit on
+        for (size_t i = 0; i < reloads.size(); ) {
+            Reload &reload = reloads[i];
+            if (reload.frame == frame || !reload.replacement->ready()) {
+                i++;
+                continue;
+            }
+            reload.replacement->finish();
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - reload.start;
+            if (reload.replacement->linked) {
+                swap(reload.target, reload.replacement.get());
+                reloaded++;
+                std::cout << "Shader reloaded: " << reload.target->name << " in " << elapsed.count() << " ms" << std::endl;
+            } else {
+                std::cout << "Shader reload failed, keeping the old program: " << reload.target->name << std::endl;
+            }
+            discard(reload);
+            reloads.erase(reloads.begin() + i);
+        }
+
+        std::chrono::duration<double, std::milli> submitCost = submitEnd - frameStart;
+        std::chrono::duration<double, std::milli> swapCost = std::chrono::steady_clock::now() - submitEnd;
+        longestSubmit = std::max(longestSubmit, submitCost.count());
+        longestSwap = std::max(longestSwap, swapCost.count());
+        longestHitch = std::max(longestHitch, submitCost.count() + swapCost.count());
+        if (queued.empty() && reloads.empty()) {
+            if (reloaded > 0)
+                std::cout << "ShaderReloader: " << reloaded << " programs, longest frame hitch "
+                          << longestHitch << " ms (submit " << longestSubmit << " ms, swap " << longestSwap << " ms"
+                          << (parallel ? ", parallel compile)" : ")") << std::endl;
+            reloaded = 0;
+            longestHitch = 0.0;
+            longestSubmit = 0.0;
+            longestSwap = 0.0;
+        }
+    }
+
+private:
+    struct Reload {
+        Shader *target;
+        std::unique_ptr<Shader> replacement;
+        std::chrono::steady_clock::time_point start;
+        // the update() that submitted it
+        unsigned long frame;
+    };
+
+    int fd = -1;
+    bool failed = false;
+    std::vector<Shader*> shaders;
+    std::vector<Shader*> queued;
+    std::vector<Reload> reloads;
+    // watch descriptor -> directory prefix as used in the shader paths
+    std::unordered_map<int, std::vector<std::string>> directories;
+    std::unordered_set<std::string> watchedDirectories;
+    unsigned long frame = 0;
+    int reloaded = 0;
+    double longestHitch = 0.0;
+    double longestSubmit = 0.0;
+    double longestSwap = 0.0;
+
+    bool start() {
+        if (fd >= 0)
+            return true;
+        if (failed)
+            return false;
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd < 0) {
+            failed = true;
+            std::cout << "ShaderReloader: inotify unavailable, hot reload disabled" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // editors either rewrite a file or rename a new one over it
+    void watchDirectory(const std::string &path) {
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        if (!watchedDirectories.insert(directory).second)
+            return;
+        int wd = inotify_add_watch(fd, directory.empty() ? "." : directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (wd >= 0)
+            directories[wd].push_back(directory);
+    }
+
+    void readEvents() {
+        alignas(struct inotify_event) char buffer[4096];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+            for (char *p = buffer; p < buffer + length; ) {
+                struct inotify_event *event = (struct inotify_event *) p;
+                p += sizeof(struct inotify_event) + event->len;
+                if (event->len == 0)
+                    continue;
+                auto it = directories.find(event->wd);
+                if (it == directories.end())
+                    continue;
+                for (const std::string &directory : it->second)
+                    changed(directory + event->name);
+            }
+        }
+    }
+
+    void changed(const std::string &path) {
+        shaderSources().invalidate(path);
+        for (Shader *shader : shaders) {
+            const std::vector<std::string> &files = shader->dependencies;
+            if (std::find(files.begin(), files.end(), path) == files.end())
+                continue;
+            // a newer save supersedes a build still in flight
+            for (size_t i = 0; i < reloads.size(); i++) {
+                if (reloads[i].target == shader) {
+                    discard(reloads[i]);
+                    reloads.erase(reloads.begin() + i);
+                    break;
+                }
+            }
+            if (std::find(queued.begin(), queued.end(), shader) == queued.end())
+                queued.push_back(shader);
+        }
+    }
+
+    void submit(Shader *target) {
+        std::vector<const char*> paths;
+        for (const std::string &path : target->stagePaths)
+            paths.push_back(path.c_str());
+        Reload reload;
+        reload.target = target;
+        reload.start = std::chrono::steady_clock::now();
+        reload.frame = frame;
+        reload.replacement.reset(new Shader(target->stageTypes, paths, target->defineSource, false,
+                                            target->feedbackVaryings));
+        reload.replacement->hotReload = false;
+        reload.replacement->name = target->name;
+        reloads.push_back(std::move(reload));
+    }
+
+    // drop the replacement together with whatever GL objects it still owns
+    void discard(Reload &reload) {
+        Shader *shader = reload.replacement.get();
+        for (unsigned int stage : shader->pendingShaders)
+            glDeleteShader(stage);
+        shader->pendingShaders.clear();
+        glDeleteProgram(shader->ID);
+        reload.replacement.reset();
+    }
+
+    // the target keeps its address, only the program behind it changes
+    void swap(Shader *target, Shader *replacement) {
+        GLint current = 0;
+        glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+        copyState(target->ID, replacement->ID);
+        std::swap(target->ID, replacement->ID);
+        target->uniformLocations.swap(replacement->uniformLocations);
+        std::swap(target->buildRevision, replacement->buildRevision);
+        // sampler units are handed out again for the new program
+        target->samplerUnits.clear();
+        target->nextSamplerUnit = 0;
+        target->dependencies.swap(replacement->dependencies);
+        if ((GLuint) current == replacement->ID)
+            glUseProgram(target->ID);
+        else
+            glUseProgram(current);
+        for (const std::string &path : target->dependencies)
+            watchDirectory(path);
+    }
+
+    // carry uniform values and block bindings from the old program over
+    static void copyState(GLuint from, GLuint to) {
+        glUseProgram(to);
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(to, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(to, i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName = name.substr(0, length);
+            if (size > 1 && uniformName.size() > 3 &&
+                uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+                uniformName.resize(uniformName.size() - 3);
+            for (GLint j = 0; j < size; j++) {
+                std::string element = size > 1 ? uniformName + "[" + std::to_string(j) + "]" : uniformName;
+                GLint source = glGetUniformLocation(from, element.c_str());
+                GLint target = glGetUniformLocation(to, element.c_str());
+                if (source >= 0 && target >= 0)
+                    copyUniform(from, source, target, type);
+            }
+        }
+
+        GLint blocks = 0;
+        glGetProgramiv(to, GL_ACTIVE_UNIFORM_BLOCKS, &blocks);
+        for (GLint i = 0; i < blocks; i++) {
+            char blockName[256];
+            glGetActiveUniformBlockName(to, i, sizeof(blockName), NULL, blockName);
+            GLuint index = glGetUniformBlockIndex(from, blockName);
+            if (index == GL_INVALID_INDEX)
+                continue;
+            GLint binding = 0;
+            glGetActiveUniformBlockiv(from, index, GL_UNIFORM_BLOCK_BINDING, &binding);
+            glUniformBlockBinding(to, i, binding);
+        }
+    }
+
+    static void copyUniform(GLuint from, GLint source, GLint target, GLenum type) {
+        GLfloat f[16];
+        GLint v[4];
+        switch (type) {
+            case GL_FLOAT:      glGetUniformfv(from, source, f); glUniform1fv(target, 1, f); break;
+            case GL_FLOAT_VEC2: glGetUniformfv(from, source, f); glUniform2fv(target, 1, f); break;
+            case GL_FLOAT_VEC3: glGetUniformfv(from, source, f); glUniform3fv(target, 1, f); break;
+            case GL_FLOAT_VEC4: glGetUniformfv(from, source, f); glUniform4fv(target, 1, f); break;
+            case GL_FLOAT_MAT2: glGetUniformfv(from, source, f); glUniformMatrix2fv(target, 1, GL_FALSE, f); break;
+            case GL_FLOAT_MAT3: glGetUniformfv(from, source, f); glUniformMatrix3fv(target, 1, GL_FALSE, f); break;
+            case GL_FLOAT_MAT4: glGetUniformfv(from, source, f); glUniformMatrix4fv(target, 1, GL_FALSE, f); break;
+            case GL_INT_VEC2:
+            case GL_BOOL_VEC2:  glGetUniformiv(from, source, v); glUniform2iv(target, 1, v); break;
+            case GL_INT_VEC3:
+            case GL_BOOL_VEC3:  glGetUniformiv(from, source, v); glUniform3iv(target, 1, v); break;
+            case GL_INT_VEC4:
+            case GL_BOOL_VEC4:  glGetUniformiv(from, source, v); glUniform4iv(target, 1, v); break;
+            case GL_INT:
+            case GL_BOOL:
+            case GL_SAMPLER_1D:
+            case GL_SAMPLER_2D:
+            case GL_SAMPLER_3D:
+            case GL_SAMPLER_CUBE:
+            case GL_SAMPLER_2D_SHADOW:
+            case GL_SAMPLER_CUBE_SHADOW:
+            case GL_SAMPLER_2D_ARRAY:
+            case GL_SAMPLER_2D_MULTISAMPLE:
+                glGetUniformiv(from, source, v); glUniform1iv(target, 1, v); break;
+            default:
+                break;
+        }
+    }
+};
+
+ShaderReloader &shaderReloader() {
+    static ShaderReloader reloader;
+    return reloader;
+}
+
+void watchShader(Shader *shader) {
+    shaderReloader().watch(shader);
+}
+
+void unwatchShader(Shader *shader) {
+    shaderReloader().unwatch(shader);
+}
+
+#endif
@@ -6,9 +6,34 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <string>
-#include <fstream>
-#include <sstream>
 #include <iostream>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <unordered_map>
+
+#include "shader_source.h"
+#include "shader_cache.h"
+
+// Number of glGetUniformLocation calls issued after program link (i.e. by the
+// set* functions). With the location table it should stay at 0 every frame.
+unsigned long shaderLocationQueries = 0;
+// Counts finished programs, gives each one a unique revision
+unsigned long shaderBuilds = 0;
+
+class Shader;
+// hot reload hooks, see shader_reload.h
+void watchShader(Shader *shader);
+void unwatchShader(Shader *shader);
+
+// A uniform location resolved once through Shader::uniform(), so hot paths
+// neither hash the name nor ask the driver again
+struct UniformHandle
+{
+    GLint location = -1;
+
+    bool valid() const { return location >= 0; }
+};
 
 class Shader
 {
@@ -17,124 +42,21 @@ public:
     // constructor generates the shader on the fly
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath)
+        : Shader({GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}, {vertexPath, fragmentPath}, "", true)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode   = vShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        }
-        catch (std::ifstream::failure e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-    }
-
-    Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath) {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string geometryCode;
-        std::string fragmentCode;
-        std::ifstream vShaderFile;
-        std::ifstream gShaderFile;
-        std::ifstream fShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try {
-            // open files
-            vShaderFile.open(vertexPath);
-            gShaderFile.open(geometryPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, gShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            gShaderStream << gShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();
-            // close file handlers
-            vShaderFile.close();
-            gShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode   = vShaderStream.str();
-            geometryCode   = gShaderStream.str();
-            fragmentCode = fShaderStream.str();
-        } catch (std::ifstream::failure e) {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* gShaderCode = geometryCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, geometry, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // geometry shader
-        geometry = glCreateShader(GL_GEOMETRY_SHADER);
-        glShaderSource(geometry, 1, &gShaderCode, NULL);
-        glCompileShader(geometry);
-        checkCompileErrors(geometry, "GEOMETRY");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, geometry);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(geometry);
-        glDeleteShader(fragment);
+    }
+
+    Shader(const char* vertexPath, const char* geometryPath, const char* fragmentPath)
+        : Shader({GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER},
+                 {vertexPath, geometryPath, fragmentPath}, "", true)
+    {
+    }
+
+    ~Shader()
+    {
+#ifndef SHADER_NO_HOT_RELOAD
+        unwatchShader(this);
+#endif
     }
     // activate the shader
     // ------------------------------------------------------------------------
@@ -142,47 +64,318 @@ public:
     { 
         glUseProgram(ID); 
     }
+    // changes whenever ID is (re)built, for caches keyed by program
+    unsigned long revision() const
+    {
+        return buildRevision;
+    }
+    // texture unit of a sampler uniform: a free unit is picked and set on the
+    // program the first time a name is asked for, -1 if the program lacks it
+    // ------------------------------------------------------------------------
+    GLint samplerUnit(const std::string &name) const
+    {
+        auto it = samplerUnits.find(name);
+        if (it != samplerUnits.end())
+            return it->second;
+        GLint unit = -1;
+        GLint loc = location(name);
+        if (loc >= 0)
+        {
+            unit = nextSamplerUnit++;
+            GLint current = 0;
+            glGetIntegerv(GL_CURRENT_PROGRAM, &current);
+            glUseProgram(ID);
+            glUniform1i(loc, unit);
+            glUseProgram(current);
+        }
+        samplerUnits.emplace(name, unit);
+        return unit;
+    }
+    // look up a uniform once, keep the handle for the render loop
+    // ------------------------------------------------------------------------
+    UniformHandle uniform(const std::string &name) const
+    {
+        return UniformHandle{location(name)};
+    }
     // utility uniform functions
     // ------------------------------------------------------------------------
     void setBool(const std::string &name, bool value) const
     {         
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value); 
+        glUniform1i(location(name), (int)value); 
     }
     // ------------------------------------------------------------------------
     void setInt(const std::string &name, int value) const
     { 
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1i(location(name), value); 
     }
     // ------------------------------------------------------------------------
     void setFloat(const std::string &name, float value) const
     { 
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value); 
+        glUniform1f(location(name), value); 
     }
 
-    void setMat4(const std::string &name, glm::mat4 value) const
+    void setMat4(const std::string &name, const glm::mat4 &value) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+        glUniformMatrix4fv(location(name), 1, GL_FALSE, glm::value_ptr(value));
     }
 
-    void setVec2(const std::string &name, glm::vec2 value) const
+    void setVec2(const std::string &name, const glm::vec2 &value) const
     {
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+        glUniform2fv(location(name), 1, glm::value_ptr(value));
     }
 
     void setVec3(const std::string &name, float f1, float f2, float f3) const
     {
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), f1, f2, f3);
+        glUniform3f(location(name), f1, f2, f3);
+    }
+
+    void setVec3(const std::string &name, const glm::vec3 &value) const
+    {
+        glUniform3fv(location(name), 1, glm::value_ptr(value));
+    }
+    // handle based variants, no lookup at all
+    // ------------------------------------------------------------------------
+    void setBool(UniformHandle handle, bool value) const
+    {
+        glUniform1i(handle.location, (int)value);
+    }
+
+    void setInt(UniformHandle handle, int value) const
+    {
+        glUniform1i(handle.location, value);
+    }
+
+    void setFloat(UniformHandle handle, float value) const
+    {
+        glUniform1f(handle.location, value);
+    }
+
+    void setMat4(UniformHandle handle, const glm::mat4 &value) const
+    {
+        glUniformMatrix4fv(handle.location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    void setVec2(UniformHandle handle, const glm::vec2 &value) const
+    {
+        glUniform2fv(handle.location, 1, glm::value_ptr(value));
     }
 
-    void setVec3(const std::string &name, glm::vec3 value) const
+    void setVec3(UniformHandle handle, float f1, float f2, float f3) const
     {
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+        glUniform3f(handle.location, f1, f2, f3);
+    }
+
+    void setVec3(UniformHandle handle, const glm::vec3 &value) const
+    {
+        glUniform3fv(handle.location, 1, glm::value_ptr(value));
     }
 
 private:
+    friend class ShaderBatch;
+    friend class ShaderVariants;
+    friend class ShaderReloader;
+
+    // state kept between submit() and finish()
+    std::vector<GLenum> stageTypes;
+    std::vector<unsigned int> pendingShaders;
+    uint64_t cacheKey = 0;
+    bool cached = false;
+    bool finished = false;
+    bool linked = false;
+    std::string name;
+    // what the program was built from, to build it again on changes
+    std::vector<std::string> stagePaths;
+    std::string defineSource;
+    // outputs captured by transform feedback, interleaved in this order
+    std::vector<std::string> feedbackVaryings;
+    std::vector<std::string> dependencies;
+    bool hotReload = true;
+    unsigned long buildRevision = 0;
+    mutable std::unordered_map<std::string, GLint> samplerUnits;
+    mutable GLint nextSamplerUnit = 0;
+    std::chrono::steady_clock::time_point buildStart;
+
+    // `defines` is inserted after the #version line of every stage
+    Shader(const std::vector<GLenum> &types, const std::vector<const char*> &paths,
+           const std::string &defines, bool finishNow, const std::vector<std::string> &varyings = {})
+        : stageTypes(types), name(paths[0]), stagePaths(paths.begin(), paths.end()), defineSource(defines),
+          feedbackVaryings(varyings)
+    {
+        submit(paths, defines);
+        if (finishNow)
+            finish();
+    }
+
+    // read, compile and link one program, or load it from the binary cache.
+    // No status is queried here so the driver can work in the background.
+    // ------------------------------------------------------------------------
+    void submit(const std::vector<const char*> &paths, const std::string &defines)
+    {
+        buildStart = std::chrono::steady_clock::now();
+        // 1. map the source of every stage and resolve its #includes
+        std::vector<ShaderPieces> sources(paths.size());
+        for (size_t i = 0; i < paths.size(); i++)
+        {
+            shaderSources().expand(paths[i], sources[i]);
+            sources[i].insertAfterVersion(defines);
+            dependencies.insert(dependencies.end(), sources[i].files.begin(), sources[i].files.end());
+        }
+        // 2. try a cached binary first, compile on any mismatch
+        ID = glCreateProgram();
+#ifndef SHADER_NO_BINARY_CACHE
+        ProgramBinaryCache &cache = programBinaryCache();
+        cacheKey = cache.key(stageTypes, sources, feedbackVaryings);
+        ProgramBinaryCache::LoadResult loaded = cache.load(cacheKey, ID);
+        cached = loaded == ProgramBinaryCache::LOADED;
+        if (loaded == ProgramBinaryCache::REJECTED)
+        {
+            // a rejected binary leaves the program unusable, start over
+            glDeleteProgram(ID);
+            ID = glCreateProgram();
+        }
+#endif
+        if (cached)
+            return;
+        for (size_t i = 0; i < stageTypes.size(); i++)
+        {
+            const ShaderPieces &code = sources[i];
+            unsigned int shader = glCreateShader(stageTypes[i]);
+            glShaderSource(shader, code.strings.size(), code.strings.data(), code.lengths.data());
+            glCompileShader(shader);
+            glAttachShader(ID, shader);
+            pendingShaders.push_back(shader);
+        }
+        if (!feedbackVaryings.empty())
+        {
+            std::vector<const char*> names;
+            for (const std::string &varying : feedbackVaryings)
+                names.push_back(varying.c_str());
+            glTransformFeedbackVaryings(ID, names.size(), names.data(), GL_INTERLEAVED_ATTRIBS);
+        }
+#ifndef SHADER_NO_BINARY_CACHE
+        cache.prepare(ID);
+#endif
+        glLinkProgram(ID);
+    }
+
+    // has the driver finished compiling and linking? always true without
+    // KHR_parallel_shader_compile, the status queries in finish() just block
+    bool ready() const
+    {
+        if (finished || cached || !glExt().parallelShaderCompile)
+            return true;
+        GLint done = GL_FALSE;
+        glGetProgramiv(ID, GL_COMPLETION_STATUS_KHR, &done);
+        return done;
+    }
+
+    // query compile/link status, then set the program up for use
+    // ------------------------------------------------------------------------
+    void finish()
+    {
+        if (finished)
+            return;
+        finished = true;
+        linked = true;
+        buildRevision = ++shaderBuilds;
+        if (!cached)
+        {
+            for (size_t i = 0; i < pendingShaders.size(); i++)
+                checkCompileErrors(pendingShaders[i], stageName(stageTypes[i]));
+            linked = checkCompileErrors(ID, "PROGRAM");
+            // delete the shaders as they're linked into our program now and no longer necessary
+            for (unsigned int shader : pendingShaders)
+            {
+                glDetachShader(ID, shader);
+                glDeleteShader(shader);
+            }
+            pendingShaders.clear();
+#ifndef SHADER_NO_BINARY_CACHE
+            if (linked)
+                programBinaryCache().store(cacheKey, ID);
+#endif
+        }
+        loadUniforms();
+#ifndef SHADER_NO_HOT_RELOAD
+        if (hotReload)
+            watchShader(this);
+#endif
+#ifdef PRINT_SHADER_TIME
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - buildStart;
+        std::cout << "Shader " << name << ": " << elapsed.count() << " ms"
+                  << (cached ? " (binary cache)" : " (compiled)") << std::endl;
+#endif
+    }
+
+    static const char* stageName(GLenum type)
+    {
+        switch (type)
+        {
+            case GL_VERTEX_SHADER: return "VERTEX";
+            case GL_GEOMETRY_SHADER: return "GEOMETRY";
+            case GL_COMPUTE_SHADER: return "COMPUTE";
+            default: return "FRAGMENT";
+        }
+    }
+
+    // name -> location of every active uniform, filled right after link.
+    // Unknown names are resolved lazily and cached too (even if -1).
+    mutable std::unordered_map<std::string, GLint> uniformLocations;
+
+    GLint location(const std::string &name) const
+    {
+#ifndef SHADER_NO_UNIFORM_CACHE
+        auto it = uniformLocations.find(name);
+        if (it != uniformLocations.end())
+            return it->second;
+#endif
+        shaderLocationQueries++;
+        GLint loc = glGetUniformLocation(ID, name.c_str());
+#ifndef SHADER_NO_UNIFORM_CACHE
+        uniformLocations.emplace(name, loc);
+#endif
+        return loc;
+    }
+
+    // enumerate all active uniforms of the linked program
+    // ------------------------------------------------------------------------
+    void loadUniforms()
+    {
+        uniformLocations.clear();
+        GLint count = 0, maxLength = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::string name(maxLength > 0 ? maxLength : 1, '\0');
+        for (GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            GLint size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, i, maxLength, &length, &size, &type, &name[0]);
+            std::string uniformName = name.substr(0, length);
+            GLint loc = glGetUniformLocation(ID, uniformName.c_str());
+            // uniforms living in a uniform block have no location
+            if (loc < 0)
+                continue;
+            uniformLocations[uniformName] = loc;
+            // arrays are reported as "name[0]", register "name" and every element
+            if (size > 1 && uniformName.size() > 3 &&
+                uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0)
+            {
+                std::string base = uniformName.substr(0, uniformName.size() - 3);
+                uniformLocations[base] = loc;
+                for (GLint j = 1; j < size; j++)
+                {
+                    std::string element = base + "[" + std::to_string(j) + "]";
+                    uniformLocations[element] = glGetUniformLocation(ID, element.c_str());
+                }
+            }
+        }
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(unsigned int shader, std::string type)
+    bool checkCompileErrors(unsigned int shader, std::string type)
     {
         int success;
         char infoLog[1024];
@@ -204,6 +397,103 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success;
+    }
+};
+
+/**
+ * Builds several programs at once: add() submits every compile and link
+ * without looking at their status, finish() collects the results. With
+ * KHR_parallel_shader_compile the programs are finished in the order the
+ * driver completes them, otherwise the first status query simply waits.
+ *
+ *     ShaderBatch batch;
+ *     shader = batch.add("a.vs", "a.fs");
+ *     other = batch.add("b.vs", "b.fs");
+ *     ... other loading work ...
+ *     batch.finish(); // before any of the shaders is used
+ */
+class ShaderBatch
+{
+public:
+    ShaderBatch() : start(std::chrono::steady_clock::now()) {}
+
+    ~ShaderBatch()
+    {
+        finish();
+    }
+
+    Shader* add(const char* vertexPath, const char* fragmentPath)
+    {
+        return add({GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}, {vertexPath, fragmentPath}, "");
+    }
+
+    Shader* add(const char* vertexPath, const char* geometryPath, const char* fragmentPath)
+    {
+        return add({GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER},
+                   {vertexPath, geometryPath, fragmentPath}, "");
+    }
+
+    // any stage list, with `defines` inserted after each #version line
+    Shader* add(const std::vector<GLenum> &types, const std::vector<const char*> &paths,
+                const std::string &defines)
+    {
+        return add(types, paths, defines, {});
+    }
+
+    // same, with `varyings` captured by transform feedback
+    Shader* add(const std::vector<GLenum> &types, const std::vector<const char*> &paths,
+                const std::string &defines, const std::vector<std::string> &varyings)
+    {
+#ifdef SHADER_NO_BATCH
+        // build synchronously, for comparing startup time
+        Shader* shader = new Shader(types, paths, defines, true, varyings);
+#else
+        Shader* shader = new Shader(types, paths, defines, false, varyings);
+        pending.push_back(shader);
+#endif
+        if (count++ == 0)
+            start = std::chrono::steady_clock::now();
+        return shader;
+    }
+
+    void finish()
+    {
+        while (!pending.empty())
+        {
+            bool progress = false;
+            for (size_t i = 0; i < pending.size(); )
+            {
+                if (pending[i]->ready())
+                {
+                    pending[i]->finish();
+                    pending.erase(pending.begin() + i);
+                    progress = true;
+                }
+                else
+                {
+                    i++;
+                }
+            }
+            if (!progress)
+                std::this_thread::yield();
+        }
+#ifdef PRINT_SHADER_TIME
+        if (count > 0)
+        {
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "ShaderBatch: " << count << " programs in " << elapsed.count() << " ms"
+                      << (glExt().parallelShaderCompile ? " (parallel compile)" : "") << std::endl;
+        }
+#endif
+        count = 0;
     }
+
+private:
+    std::vector<Shader*> pending;
+    int count = 0;
+    std::chrono::steady_clock::time_point start;
 };
+
+#include "shader_reload.h"
 #endif
\ No newline at end of file
@@ -0,0 +1,261 @@
+#ifndef SHADER_SOURCE_H
+#define SHADER_SOURCE_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+class MappedFile;
+
+/**
+ * The source of one shader stage as a list of pieces that go straight to
+ * glShaderSource(shader, count, strings, lengths). Pieces point into the
+ * mapped files of ShaderSourceCache, which stay mapped while the pieces
+ * hold them; only the small "#line" directives between them are owned here.
+ */
+struct ShaderPieces {
+    std::vector<const GLchar*> strings;
+    std::vector<GLint> lengths;
+    std::deque<std::string> owned;
+    std::vector<std::shared_ptr<const MappedFile>> mappings;
+    // every file read for this stage, for watching them
+    std::vector<std::string> files;
+
+    void add(const char *data, size_t length) {
+        if (length == 0)
+            return;
+        strings.push_back(data);
+        lengths.push_back((GLint) length);
+    }
+
+    void addOwned(const std::string &text) {
+        owned.push_back(text);
+        add(owned.back().data(), owned.back().size());
+    }
+
+    // put `text` (e.g. #defines) right after the #version line, which GLSL
+    // wants first, and restore the line numbering of what follows
+    void insertAfterVersion(const std::string &text) {
+        if (text.empty())
+            return;
+        size_t split = 0;
+        int line = 1;
+        if (!strings.empty()) {
+            const char *data = strings[0];
+            const char *end = data + lengths[0];
+            static const char directive[] = "#version";
+            const char *version = std::search(data, end, directive, directive + sizeof(directive) - 1);
+            if (version != end) {
+                const char *eol = std::find(version, end, '\n');
+                split = eol == end ? lengths[0] : eol - data + 1;
+                line += std::count(data, data + split, '\n');
+            }
+        }
+        owned.push_back(text + "\n#line " + std::to_string(line) + " 0\n");
+        size_t at = 0;
+        if (split > 0) {
+            // cut the first piece in two around the inserted text
+            GLint rest = lengths[0] - (GLint) split;
+            lengths[0] = (GLint) split;
+            if (rest > 0) {
+                strings.insert(strings.begin() + 1, strings[0] + split);
+                lengths.insert(lengths.begin() + 1, rest);
+            }
+            at = 1;
+        }
+        strings.insert(strings.begin() + at, owned.back().data());
+        lengths.insert(lengths.begin() + at, (GLint) owned.back().size());
+    }
+};
+
+/**
+ * A read-only mapping of a whole file, unmapped when dropped.
+ */
+class MappedFile {
+public:
+    const char *data = NULL;
+    size_t size = 0;
+
+    explicit MappedFile(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return;
+        struct stat st;
+        if (fstat(fd, &st) == 0) {
+            mapped = st;
+            if (st.st_size > 0) {
+                void *addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (addr != MAP_FAILED) {
+                    data = (const char *) addr;
+                    size = st.st_size;
+                }
+            }
+        }
+        close(fd);
+        valid = true;
+    }
+
+    ~MappedFile() {
+        if (data)
+            munmap((void *) data, size);
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool ok() const { return valid; }
+
+    // whether `st` still describes the file as it was when mapped
+    bool unchanged(const struct stat &st) const {
+        return valid && st.st_dev == mapped.st_dev && st.st_ino == mapped.st_ino && st.st_size == mapped.st_size
+               && st.st_mtim.tv_sec == mapped.st_mtim.tv_sec && st.st_mtim.tv_nsec == mapped.st_mtim.tv_nsec;
+    }
+
+private:
+    bool valid = false;
+    struct stat mapped = {};
+};
+
+/**
+ * Process wide cache of shader files, shared by every program.
+ *
+ * Files are mmapped and handed to the driver piecewise, so no source is
+ * ever copied into a std::string. A mapping is reused only while the file
+ * keeps its inode, size and modification time; editors that truncate a
+ * file before writing it again would otherwise leave a mapping reaching
+ * past its end. `#include "file"` lines are resolved
+ * relative to the including file, or against the built-in chunks
+ * registered with addBuiltin(). Each file is included at most once per
+ * stage, which makes include guards unnecessary.
+ */
+class ShaderSourceCache {
+public:
+    void addBuiltin(const std::string &name, const std::string &source) {
+        builtins[name] = source;
+    }
+
+    // drop a cached mapping so the next expand() reads the file again
+    void invalidate(const std::string &path) {
+        files.erase(path);
+    }
+
+    bool expand(const std::string &path, ShaderPieces &out) {
+        std::unordered_set<std::string> included;
+        int fileIndex = 0;
+        return expand(path, out, included, fileIndex, 0);
+    }
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<const MappedFile>> files;
+    std::unordered_map<std::string, std::string> builtins;
+
+    static const int MAX_DEPTH = 16;
+
+    std::shared_ptr<const MappedFile> file(const std::string &path) {
+        auto it = files.find(path);
+        struct stat st;
+        // an older mapping lives on in the pieces still pointing into it
+        if (it != files.end() && (stat(path.c_str(), &st) != 0 || !it->second->unchanged(st))) {
+            files.erase(it);
+            it = files.end();
+        }
+        if (it == files.end())
+            it = files.emplace(path, std::make_shared<const MappedFile>(path)).first;
+        return it->second->ok() ? it->second : NULL;
+    }
+
+    bool expand(const std::string &path, ShaderPieces &out,
+                std::unordered_set<std::string> &included, int &fileIndex, int depth) {
+        if (depth > MAX_DEPTH) {
+            std::cout << "ERROR::SHADER::INCLUDE_TOO_DEEP: " << path << std::endl;
+            return false;
+        }
+        if (!included.insert(path).second)
+            return true;
+
+        const char *data;
+        size_t size;
+        auto builtin = builtins.find(path);
+        if (builtin != builtins.end()) {
+            data = builtin->second.data();
+            size = builtin->second.size();
+        } else {
+            std::shared_ptr<const MappedFile> mapped = file(path);
+            if (!mapped) {
+                std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+                return false;
+            }
+            data = mapped->data;
+            size = mapped->size;
+            out.mappings.push_back(mapped);
+            out.files.push_back(path);
+        }
+        int index = fileIndex++;
+        std::string directory = path.substr(0, path.find_last_of('/') + 1);
+        if (depth > 0)
+            out.addOwned("#line 1 " + std::to_string(index) + "\n");
+
+        size_t pieceStart = 0, lineStart = 0;
+        int line = 1;
+        while (lineStart < size) {
+            size_t lineEnd = lineStart;
+            while (lineEnd < size && data[lineEnd] != '\n')
+                lineEnd++;
+            std::string name;
+            if (includeName(data + lineStart, data + lineEnd, name)) {
+                out.add(data + pieceStart, lineStart - pieceStart);
+                std::string target = builtins.count(name) ? name : directory + name;
+                if (!expand(target, out, included, fileIndex, depth + 1))
+                    return false;
+                // keep compiler messages pointing at the right file and line
+                out.addOwned("\n#line " + std::to_string(line + 1) + " " + std::to_string(index) + "\n");
+                pieceStart = lineEnd < size ? lineEnd + 1 : size;
+            }
+            lineStart = lineEnd + 1;
+            line++;
+        }
+        out.add(data + pieceStart, size - pieceStart);
+        return true;
+    }
+
+    // matches `#include "name"` with optional blanks
+    static bool includeName(const char *begin, const char *end, std::string &name) {
+        const char *p = begin;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        static const char directive[] = "#include";
+        size_t length = sizeof(directive) - 1;
+        if ((size_t) (end - p) < length || std::string(p, length) != directive)
+            return false;
+        p += length;
+        while (p < end && (*p == ' ' || *p == '\t'))
+            p++;
+        if (p == end || *p != '"')
+            return false;
+        const char *close = p + 1;
+        while (close < end && *close != '"')
+            close++;
+        if (close == end)
+            return false;
+        name.assign(p + 1, close);
+        return true;
+    }
+};
+
+ShaderSourceCache &shaderSources() {
+    static ShaderSourceCache cache;
+    return cache;
+}
+
+#endif
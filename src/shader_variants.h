@@ -0,0 +1,161 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <glad/glad.h>
+
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "shader_s.h"
+
+/**
+ * A set of #defines selecting one compile-time configuration of a shader,
+ * e.g. the number of point lights or the PCF kernel size. Names are kept
+ * sorted so the same set always gives the same key.
+ */
+class ShaderDefines {
+public:
+    ShaderDefines &set(const std::string &name, int value) {
+        return set(name, std::to_string(value));
+    }
+
+    ShaderDefines &set(const std::string &name, const std::string &value) {
+        values[name] = value;
+        return *this;
+    }
+
+    // "NAME=VALUE,..." identifies the variant
+    std::string key() const {
+        std::string result;
+        for (const auto &define : values) {
+            if (!result.empty())
+                result += ",";
+            result += define.first + "=" + define.second;
+        }
+        return result;
+    }
+
+    // the text inserted after #version
+    std::string source() const {
+        std::string result;
+        for (const auto &define : values)
+            result += "#define " + define.first + " " + define.second + "\n";
+        return result;
+    }
+
+private:
+    std::map<std::string, std::string> values;
+};
+
+/**
+ * All compiled permutations of one shader, keyed by their defines.
+ *
+ * The shader files guard each option with #ifndef and a default, so the
+ * same source also works as a plain Shader. With the values known at
+ * compile time loops get a constant trip count and dead branches vanish.
+ * Declare the variants a scene needs with prewarm() at startup; get()
+ * builds a missing one on the spot, which stalls that frame.
+ *
+ *     ShaderVariants variants("a.vs", "a.fs");
+ *     variants.setup = [](Shader &shader) { ... samplers, uniform blocks ... };
+ *     variants.prewarm({ShaderDefines().set("PCF_KERNEL_SIZE", 1),
+ *                       ShaderDefines().set("PCF_KERNEL_SIZE", 3)});
+ *     variants.get(ShaderDefines().set("PCF_KERNEL_SIZE", 3)).use();
+ */
+class ShaderVariants {
+public:
+    // run once for every new program, before it is handed out
+    std::function<void(Shader &)> setup;
+
+    ShaderVariants(const char* vertexPath, const char* fragmentPath)
+        : types({GL_VERTEX_SHADER, GL_FRAGMENT_SHADER}), paths({vertexPath, fragmentPath})
+    {
+    }
+
+    ShaderVariants(const char* vertexPath, const char* geometryPath, const char* fragmentPath)
+        : types({GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER}),
+          paths({vertexPath, geometryPath, fragmentPath})
+    {
+    }
+
+    ShaderVariants(const ShaderVariants &) = delete;
+    ShaderVariants &operator=(const ShaderVariants &) = delete;
+
+    Shader &get(const ShaderDefines &defines) {
+        std::string key = defines.key();
+        auto it = variants.find(key);
+        if (it == variants.end()) {
+#ifdef PRINT_SHADER_TIME
+            std::cout << "ShaderVariants: " << paths.back() << " {" << key
+                      << "} was not prewarmed" << std::endl;
+#endif
+            ShaderBatch batch;
+            it = submit(batch, defines, key);
+        }
+        return prepared(it->second);
+    }
+
+    // compile every listed variant at once
+    void prewarm(const std::vector<ShaderDefines> &list) {
+        ShaderBatch batch;
+        prewarm(list, batch);
+        batch.finish();
+    }
+
+    // only submit the compiles, finish them together with the rest of `batch`
+    void prewarm(const std::vector<ShaderDefines> &list, ShaderBatch &batch) {
+        for (const ShaderDefines &defines : list) {
+            std::string key = defines.key();
+            if (variants.find(key) == variants.end())
+                submit(batch, defines, key);
+        }
+    }
+
+    // e.g. to set per-frame uniforms on every variant in use
+    void forEach(const std::function<void(Shader &)> &fn) {
+        for (auto &variant : variants)
+            fn(prepared(variant.second));
+    }
+
+    size_t size() const {
+        return variants.size();
+    }
+
+private:
+    struct Variant {
+        std::unique_ptr<Shader> shader;
+        bool ready = false;
+    };
+
+    std::vector<GLenum> types;
+    std::vector<std::string> paths;
+    std::unordered_map<std::string, Variant> variants;
+
+    std::unordered_map<std::string, Variant>::iterator submit(ShaderBatch &batch,
+            const ShaderDefines &defines, const std::string &key) {
+        std::vector<const char*> stagePaths;
+        for (const std::string &path : paths)
+            stagePaths.push_back(path.c_str());
+        Variant variant;
+        variant.shader.reset(batch.add(types, stagePaths, defines.source()));
+        variant.shader->name += " {" + key + "}";
+        return variants.emplace(key, std::move(variant)).first;
+    }
+
+    Shader &prepared(Variant &variant) {
+        if (!variant.ready) {
+            variant.shader->finish();
+            if (setup)
+                setup(*variant.shader);
+            variant.ready = true;
+        }
+        return *variant.shader;
+    }
+};
+
+#endif
@@ -0,0 +1,242 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <iostream>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "stb_image.h"
+#include "thread_pool.h"
+
+/**
+ * Process wide cache of 2D textures shared by every Model (and every
+ * loadTexture() call). Entries are keyed by the canonical file path plus
+ * the parameters that change the GL object (wrap modes, sRGB), so
+ * "a/../tex.png" and "tex.png" decode once. Each acquire() takes a
+ * reference and release() drops it; the texture is deleted with its last
+ * reference.
+ *
+ * Loading a list of textures at once decodes every miss in parallel on a
+ * ThreadPool, then uploads them on the calling (GL) thread in list order.
+ *
+ * Build with -DTEXTURE_NO_CACHE to decode every request again.
+ */
+class TextureCache {
+public:
+    struct Stats {
+        unsigned long requests = 0;
+        unsigned long decodes = 0;
+        unsigned long uploadBytes = 0;
+        // summed over all decoding threads
+        double decodeMs = 0.0;
+        // wall clock time spent in acquire()
+        double loadMs = 0.0;
+    };
+
+    struct Request {
+        std::string path;
+        int wrapS = GL_REPEAT;
+        int wrapT = GL_REPEAT;
+        bool gammaCorrection = false;
+    };
+
+    // decoded pixels, freed once uploaded
+    struct Image {
+        unsigned char *data;
+        int width, height, nrChannels;
+        double decodeMs;
+    };
+
+    Stats stats;
+
+    unsigned int acquire(const std::string &filepath, int wrapS, int wrapT, bool gammaCorrection) {
+        Request request;
+        request.path = filepath;
+        request.wrapS = wrapS;
+        request.wrapT = wrapT;
+        request.gammaCorrection = gammaCorrection;
+        return acquire(std::vector<Request>(1, request), NULL)[0];
+    }
+
+    // one texture per request, in the same order; pool == NULL decodes inline
+    std::vector<unsigned int> acquire(const std::vector<Request> &requests, ThreadPool *pool) {
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::string> requestKeys;
+        std::vector<std::future<Image>> images(requests.size());
+        std::unordered_map<std::string, size_t> firstRequest;
+        // 1. decode every image that is neither cached nor already on its way
+        for (size_t i = 0; i < requests.size(); i++) {
+            const Request &request = requests[i];
+            requestKeys.push_back(key(request));
+#ifndef TEXTURE_NO_CACHE
+            if (entries.count(requestKeys[i]) || !firstRequest.emplace(requestKeys[i], i).second)
+                continue;
+#endif
+            std::string path = request.path;
+            if (pool)
+                images[i] = pool->submit([path] { return decode(path); });
+            else
+                images[i] = std::async(std::launch::deferred, [path] { return decode(path); });
+        }
+        // 2. upload on this thread as the decodes come in, in request order
+        std::vector<unsigned int> ids;
+        for (size_t i = 0; i < requests.size(); i++) {
+            stats.requests++;
+#ifndef TEXTURE_NO_CACHE
+            auto it = entries.find(requestKeys[i]);
+            if (it != entries.end()) {
+                it->second.refs++;
+                ids.push_back(it->second.id);
+                continue;
+            }
+#endif
+            Image image = images[i].get();
+            unsigned int id = upload(requests[i], image);
+            ids.push_back(id);
+#ifndef TEXTURE_NO_CACHE
+            entries[requestKeys[i]] = Entry{id, 1};
+            keys[id] = requestKeys[i];
+#endif
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        stats.loadMs += elapsed.count();
+        return ids;
+    }
+
+    /*  For loaders that upload the pixels themselves, e.g. across frames  */
+
+    // takes a reference to an already loaded texture
+    bool find(const std::string &key, unsigned int &id) {
+#ifndef TEXTURE_NO_CACHE
+        auto it = entries.find(key);
+        if (it != entries.end()) {
+            stats.requests++;
+            it->second.refs++;
+            id = it->second.id;
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    // takes over a texture created from `image`, with one reference
+    void adopt(const std::string &key, unsigned int id, const Image &image) {
+        stats.requests++;
+        if (image.data) {
+            stats.decodes++;
+            stats.decodeMs += image.decodeMs;
+            stats.uploadBytes += (unsigned long) image.width * image.height * image.nrChannels;
+        }
+#ifndef TEXTURE_NO_CACHE
+        entries[key] = Entry{id, 1};
+        keys[id] = key;
+#endif
+    }
+
+    static std::string key(const Request &request) {
+        return canonicalPath(request.path) + "|" + std::to_string(request.wrapS) + "|" +
+               std::to_string(request.wrapT) + (request.gammaCorrection ? "|srgb" : "");
+    }
+
+    // CPU only, safe on any thread
+    static Image decode(const std::string &filepath) {
+        auto start = std::chrono::steady_clock::now();
+        Image image;
+        // stbi_set_flip_vertically_on_load(true);
+        image.data = stbi_load(filepath.c_str(), &image.width, &image.height, &image.nrChannels, 0);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        image.decodeMs = elapsed.count();
+        return image;
+    }
+
+    static void pixelFormat(const Request &request, int nrChannels, GLenum &internal, GLenum &mode) {
+        if (nrChannels == 1) {
+            internal = mode = GL_RED;
+        } else if (nrChannels == 3) {
+            internal = request.gammaCorrection ? GL_SRGB : GL_RGB;
+            mode = GL_RGB;
+        } else {
+            internal = request.gammaCorrection ? GL_SRGB_ALPHA : GL_RGBA;
+            mode = GL_RGBA;
+        }
+    }
+
+    void release(unsigned int id) {
+#ifndef TEXTURE_NO_CACHE
+        auto key = keys.find(id);
+        if (key == keys.end())
+            return;
+        auto it = entries.find(key->second);
+        if (--it->second.refs > 0)
+            return;
+        entries.erase(it);
+        keys.erase(key);
+#endif
+        glDeleteTextures(1, &id);
+    }
+
+    void printStats(const char *label) const {
+        std::cout << "Textures " << label << ": " << stats.requests << " requests, "
+                  << stats.decodes << " decodes, " << stats.uploadBytes / 1024 << " KB uploaded, "
+                  << stats.loadMs << " ms loading (" << stats.decodeMs << " ms decoding on all threads)"
+                  << std::endl;
+    }
+
+private:
+    struct Entry {
+        unsigned int id;
+        int refs;
+    };
+
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<unsigned int, std::string> keys;
+
+    static std::string canonicalPath(const std::string &path) {
+        char resolved[PATH_MAX];
+        return realpath(path.c_str(), resolved) ? std::string(resolved) : path;
+    }
+
+    unsigned int upload(const Request &request, Image &image) {
+        unsigned int texture = 0;
+        std::cout << "Start loading texture: " << request.path << std::endl;
+        // Create texture
+        glGenTextures(1, &texture);
+        GLenum mode;
+        GLenum internal;
+        if (image.data) {
+            stats.decodes++;
+            stats.decodeMs += image.decodeMs;
+            pixelFormat(request, image.nrChannels, internal, mode);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            // Load data
+            glTexImage2D(GL_TEXTURE_2D, 0, internal, image.width, image.height, 0, mode, GL_UNSIGNED_BYTE, image.data);
+            glGenerateMipmap(GL_TEXTURE_2D);
+            stats.uploadBytes += (unsigned long) image.width * image.height * image.nrChannels;
+            // Configure wrap and filter type
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, request.wrapS);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, request.wrapT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        } else {
+            std::cout << "Failed to load texture" << std::endl;
+        }
+        // Free image
+        stbi_image_free(image.data);
+        image.data = NULL;
+        return texture;
+    }
+};
+
+TextureCache &textureCache() {
+    static TextureCache cache;
+    return cache;
+}
+
+#endif
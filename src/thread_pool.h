@@ -0,0 +1,132 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+/**
+ * A fixed set of worker threads running queued jobs in FIFO order.
+ * Jobs must not touch GL: the context belongs to the main thread.
+ *
+ *     std::future<Image> image = threadPool().submit([&] { return decode(path); });
+ *     upload(image.get());
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned int threads = defaultThreads()) {
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back([this] { run(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread &worker : workers)
+            worker.join();
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    template <typename F>
+    auto submit(F &&job) -> std::future<decltype(job())> {
+        typedef decltype(job()) Result;
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+        std::future<Result> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push([task] { (*task)(); });
+        }
+        wake.notify_one();
+        return result;
+    }
+
+    // fn(0) .. fn(count - 1) spread over the workers and the calling thread,
+    // returns once all are done. Safe from inside a job: when no worker is
+    // free the caller simply runs every item itself.
+    template <typename F>
+    void parallelFor(size_t count, F &&fn) {
+        if (count == 0)
+            return;
+        struct Progress {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+        };
+        std::shared_ptr<Progress> progress = std::make_shared<Progress>();
+        size_t total = count;
+        // a helper that starts late finds nothing left and never calls fn
+        auto work = [progress, total, &fn] {
+            size_t i;
+            while ((i = progress->next++) < total) {
+                fn(i);
+                if (++progress->done == total) {
+                    std::lock_guard<std::mutex> lock(progress->mutex);
+                    progress->finished.notify_all();
+                }
+            }
+        };
+        size_t helpers = std::min((size_t) workers.size(), count - 1);
+        for (size_t i = 0; i < helpers; i++) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                jobs.push(work);
+            }
+            wake.notify_one();
+        }
+        work();
+        std::unique_lock<std::mutex> lock(progress->mutex);
+        progress->finished.wait(lock, [&] { return progress->done == total; });
+    }
+
+    unsigned int size() const {
+        return workers.size();
+    }
+
+    static unsigned int defaultThreads() {
+        unsigned int threads = std::thread::hardware_concurrency();
+        return threads > 0 ? threads : 4;
+    }
+
+private:
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+
+    void run() {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+                if (stopping && jobs.empty())
+                    return;
+                job = std::move(jobs.front());
+                jobs.pop();
+            }
+            job();
+        }
+    }
+};
+
+// shared pool, one thread per core
+ThreadPool &threadPool() {
+    static ThreadPool pool;
+    return pool;
+}
+
+#endif
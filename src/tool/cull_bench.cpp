@@ -0,0 +1,85 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include "../frustum.h"
+
+// Culls a synthetic scene of boxes (1M by default) scattered around a
+// camera, one Frustum::intersects() call per box and with CullBoxes::cull(),
+// and checks both agree:
+//     cull_bench [boxes] [runs]
+// Build with -mavx to test 8 boxes at a time instead of 4.
+
+float randomFloat() {
+    return rand() / (float) RAND_MAX * 2.0f - 1.0f;
+}
+
+template <typename F>
+double measure(F &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+    size_t count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int runs = argc > 2 ? atoi(argv[2]) : 20;
+    if (count == 0 || runs <= 0) {
+        std::cout << "\n    Usage: cull_bench [boxes] [runs]\n" << std::endl;
+        return -1;
+    }
+
+    // a 200 unit cube around the camera, which sees about a twentieth of it
+    std::vector<glm::vec3> boundsMin(count), boundsMax(count);
+    CullBoxes boxes;
+    boxes.reserve(count);
+    for (size_t i = 0; i < count; i++) {
+        glm::vec3 center = glm::vec3(randomFloat(), randomFloat(), randomFloat()) * 100.0f;
+        glm::vec3 extent = glm::abs(glm::vec3(randomFloat(), randomFloat(), randomFloat())) * 2.0f;
+        boundsMin[i] = center - extent;
+        boundsMax[i] = center + extent;
+        boxes.add(boundsMin[i], boundsMax[i]);
+    }
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 100.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(0.0f), glm::vec3(0.3f, 0.1f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustum frustum(projection * view);
+
+    std::vector<unsigned char> scalar(count), simd(count);
+    size_t scalarVisible = 0, simdVisible = 0;
+    double scalarMs = 1e30, simdMs = 1e30;
+    for (int run = 0; run < runs; run++) {
+        scalarMs = std::min(scalarMs, measure([&] {
+            scalarVisible = 0;
+            for (size_t i = 0; i < count; i++) {
+                scalar[i] = frustum.intersects(boundsMin[i], boundsMax[i]);
+                scalarVisible += scalar[i];
+            }
+        }));
+        simdMs = std::min(simdMs, measure([&] {
+            simdVisible = boxes.cull(frustum, simd.data());
+        }));
+    }
+    // contracted multiply-adds may round a box lying exactly on a plane differently
+    size_t differ = 0;
+    for (size_t i = 0; i < count; i++)
+        differ += scalar[i] != simd[i];
+
+#ifdef __AVX__
+    const char *width = "AVX, 8";
+#elif defined(__SSE2__)
+    const char *width = "SSE2, 4";
+#else
+    const char *width = "scalar, 1";
+#endif
+    std::cout << count << " boxes, " << simdVisible << " visible, " << count - simdVisible << " culled" << std::endl;
+    std::cout << "one at a time:  " << scalarMs << " ms" << std::endl;
+    std::cout << "CullBoxes (" << width << " per test): " << simdMs << " ms (" << scalarMs / simdMs << "x, "
+              << count / simdMs / 1000.0 << "M boxes/s)" << std::endl;
+    if (differ > count / 100000) {
+        std::cout << "error: " << differ << " boxes differ (" << scalarVisible << " visible one at a time)" << std::endl;
+        return 1;
+    }
+    return 0;
+}
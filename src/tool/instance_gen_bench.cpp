@@ -0,0 +1,158 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "../asteroid_belt.h"
+
+// Builds the asteroid belt's instance matrices the way instancing.cpp used
+// to (rand() and glm::translate / scale / rotate, one after the other) and
+// with AsteroidBelt::generate() on 1..N threads, for 100k, 1M and 10M rocks
+// unless counts are given, and checks every thread count gives the same
+// bytes and matches glm. Then the same for CompactInstances, how long one
+// pass reading each format takes, as every frame's culling does, and what
+// a frame of the animated belt costs to write:
+//     instance_gen_bench [instances...]
+
+// what prepareDraw used to do
+void generateOld(unsigned int amount, glm::mat4 *out) {
+    float radius = 150.0f, offset = 25.0f;
+    srand(1);
+    for (unsigned int i = 0; i < amount; i++) {
+        glm::mat4 model(1.0f);
+        float angle = (float) i / (float) amount * 360.0f;
+        float displacement = (rand() % (int) (2 * offset * 100)) / 100.0f - offset;
+        float x = sin(angle) * radius + displacement;
+        displacement = (rand() % (int) (2 * offset * 100)) / 100.0f - offset;
+        float y = displacement * 0.4f;
+        displacement = (rand() % (int) (2 * offset * 100)) / 100.0f - offset;
+        float z = cos(angle) * radius + displacement;
+        model = glm::translate(model, glm::vec3(x, y, z));
+        float scale = (rand() % 20) / 100.0f + 0.05;
+        model = glm::scale(model, glm::vec3(scale));
+        float rotAngle = (rand() % 360);
+        model = glm::rotate(model, rotAngle, glm::vec3(0.4f, 0.6f, 0.8f));
+        out[i] = model;
+    }
+}
+
+template <typename F>
+double measure(F &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// keeps the read passes from being optimised away
+volatile float readSink;
+
+// every instance's position, so the whole buffer comes through the cache
+template <typename Instance, typename Position>
+double readPass(const Instance *instances, size_t count, Position &&position) {
+    return measure([&] {
+        float sum = 0.0f;
+        for (size_t i = 0; i < count; i++)
+            sum += position(instances[i]);
+        readSink = sum;
+    });
+}
+
+int main(int argc, char **argv) {
+    std::vector<unsigned int> counts;
+    for (int i = 1; i < argc; i++)
+        counts.push_back(atoi(argv[i]));
+    if (counts.empty())
+        counts = {100000, 1000000, 10000000};
+    for (unsigned int count : counts) {
+        if (count == 0) {
+            std::cout << "\n    Usage: instance_gen_bench [instances...]\n" << std::endl;
+            return -1;
+        }
+    }
+
+    // at least two, so the check below always compares a split run
+    unsigned int maxThreads = std::max(ThreadPool::defaultThreads(), 2u);
+    for (unsigned int count : counts) {
+        AsteroidBelt belt(count);
+        std::unique_ptr<glm::mat4[]> reference(new glm::mat4[count]), out(new glm::mat4[count]);
+        // touch the pages once so the first run does not pay for them
+        std::fill_n(reference.get(), count, glm::mat4(0.0f));
+        std::fill_n(out.get(), count, glm::mat4(0.0f));
+
+        double oldMs = measure([&] { generateOld(count, reference.get()); });
+        std::cout << count << " instances" << std::endl;
+        std::cout << "  rand() + glm:  " << oldMs << " ms" << std::endl;
+
+        belt.generate(reference.get(), NULL);
+        // the SIMD composition against glm's, instance by instance
+        float maxError = 0.0f;
+        for (size_t i = 0; i < count; i += 97) {
+            glm::mat4 expected = belt.matrix(i);
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    maxError = std::max(maxError, std::abs(expected[c][r] - reference[i][c][r]));
+        }
+        if (maxError > 1e-4f) {
+            std::cout << "error: differs from glm by " << maxError << std::endl;
+            return 1;
+        }
+
+        for (unsigned int threads = 1; threads <= maxThreads; threads *= 2) {
+            // the calling thread takes part too
+            std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : NULL);
+            double ms = measure([&] { belt.generate(out.get(), pool.get()); });
+            std::cout << "  " << threads << (threads > 1 ? " threads: " : " thread:  ") << ms << " ms ("
+                      << oldMs / ms << "x)" << std::endl;
+            if (memcmp(out.get(), reference.get(), count * sizeof(glm::mat4)) != 0) {
+                std::cout << "error: " << threads << " threads give different matrices" << std::endl;
+                return 1;
+            }
+            std::fill_n(out.get(), count, glm::mat4(0.0f));
+        }
+
+        std::unique_ptr<CompactInstance[]> compact(new CompactInstance[count]), compactOut(new CompactInstance[count]);
+        memset(compact.get(), 0, count * sizeof(CompactInstance));
+        memset(compactOut.get(), 0, count * sizeof(CompactInstance));
+        double compactMs = measure([&] { belt.generate(compact.get(), NULL); });
+        std::unique_ptr<ThreadPool> pool(new ThreadPool(maxThreads - 1));
+        double compactPoolMs = measure([&] { belt.generate(compactOut.get(), pool.get()); });
+        std::cout << "  compact, 1 thread:  " << compactMs << " ms, " << maxThreads << " threads: "
+                  << compactPoolMs << " ms" << std::endl;
+        if (memcmp(compact.get(), compactOut.get(), count * sizeof(CompactInstance)) != 0) {
+            std::cout << "error: " << maxThreads << " threads give different compact instances" << std::endl;
+            return 1;
+        }
+        // what the vertex shader rebuilds against glm's matrix
+        float compactError = 0.0f;
+        for (size_t i = 0; i < count; i += 97) {
+            glm::mat4 expected = belt.matrix(i), unpacked = unpackInstance(compact[i]);
+            for (int c = 0; c < 4; c++)
+                for (int r = 0; r < 4; r++)
+                    compactError = std::max(compactError, std::abs(expected[c][r] - unpacked[c][r]));
+        }
+        if (compactError > 1e-3f) {
+            std::cout << "error: compact instances differ from glm by " << compactError << std::endl;
+            return 1;
+        }
+
+        double matrixReadMs = readPass(reference.get(), count, [](const glm::mat4 &m) { return m[3][0]; });
+        double compactReadMs = readPass(compact.get(), count,
+                                        [](const CompactInstance &instance) { return instance.Position[0]; });
+        std::cout << "  one pass over mat4: " << count * sizeof(glm::mat4) / (1024.0 * 1024.0) << " MB, "
+                  << matrixReadMs << " ms" << std::endl;
+        std::cout << "  one pass over compact: " << count * sizeof(CompactInstance) / (1024.0 * 1024.0) << " MB, "
+                  << compactReadMs << " ms (" << matrixReadMs / compactReadMs << "x, largest error "
+                  << compactError << ")" << std::endl;
+
+        // the orbits and spins on top, as instancing.cpp -DROCKS_ANIMATED does every frame
+        belt.time = 100.0f;
+        double animatedMs = measure([&] { belt.generate(out.get(), pool.get()); });
+        double animatedCompactMs = measure([&] { belt.generate(compactOut.get(), pool.get()); });
+        std::cout << "  animated frame on " << maxThreads << " threads: " << animatedMs << " ms mat4, "
+                  << animatedCompactMs << " ms compact" << std::endl;
+    }
+    return 0;
+}
@@ -0,0 +1,99 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "../model.h"
+
+// Prints how well each model's meshes use the post-transform vertex cache
+// (see mesh_optimize.h) as Assimp returns them and after the import time
+// optimisation, what VERTEX_PACKED (see vertex_format.h) saves and costs in
+// accuracy, and what 16 bit indices save once large meshes are split, no
+// GPU needed:
+//     mesh_report ../04_advanced_opengl/model/planet/planet.obj ../04_advanced_opengl/model/rock/rock.obj
+
+VertexCacheStats cacheStats(const ModelImporter &importer) {
+    VertexCacheStats stats;
+    for (const MeshData &mesh : importer.meshes)
+        stats += analyzeVertexCache(mesh.indices, mesh.vertices.size());
+    return stats;
+}
+
+PackingError packingError(const ModelImporter &importer) {
+    PackingError error;
+    for (const MeshData &mesh : importer.meshes)
+        error += measurePackingError(mesh.vertices.data(), mesh.vertices.size());
+    return error;
+}
+
+// index buffer sizes of all models, 32 bit as before and as Mesh picks now
+size_t totalWideIndexBytes = 0, totalIndexBytes = 0;
+
+size_t indexBytes(const ModelImporter &importer) {
+    size_t bytes = 0;
+    for (const MeshData &mesh : importer.meshes)
+        bytes += mesh.indices.size() * indexSize(indexTypeFor(mesh.vertices.size()));
+    return bytes;
+}
+
+size_t vertexCount(const ModelImporter &importer) {
+    size_t count = 0;
+    for (const MeshData &mesh : importer.meshes)
+        count += mesh.vertices.size();
+    return count;
+}
+
+bool report(const std::string &path) {
+    ModelImporter original;
+    original.optimize = false;
+    original.splitVertices = 0;
+    if (!original.import(path))
+        return false;
+    ModelImporter optimized;
+    optimized.optimize = true;
+    auto start = std::chrono::steady_clock::now();
+    optimized.import(path);
+    std::chrono::duration<double, std::milli> optimizedMs = std::chrono::steady_clock::now() - start;
+
+    VertexCacheStats before = cacheStats(original);
+    VertexCacheStats after = cacheStats(optimized);
+    std::cout << path << ": " << original.meshes.size() << " meshes, " << before.triangles << " triangles" << std::endl;
+    std::cout << "    ACMR " << before.acmr() << " -> " << after.acmr()
+              << ", ATVR " << before.atvr() << " -> " << after.atvr()
+              << " (cache of " << VERTEX_CACHE_SIZE << ", import with optimisation "
+              << optimizedMs.count() << " ms)" << std::endl;
+
+    PackingError error = packingError(original);
+    std::cout << "    vertices " << error.vertices * sizeof(Vertex) << " -> "
+              << error.vertices * sizeof(PackedVertex) << " bytes packed ("
+              << sizeof(Vertex) << " -> " << sizeof(PackedVertex) << " per vertex)" << std::endl;
+    std::cout << "    packing error, mean / max: position " << error.positionMean() << " / " << error.positionMax
+              << ", normal " << error.normalMean() << " / " << error.normalMax << " deg"
+              << ", texcoord " << error.texCoordMean() << " / " << error.texCoordMax << std::endl;
+
+    size_t wideBytes = before.triangles * 3 * sizeof(unsigned int);
+    size_t narrowBytes = indexBytes(optimized);
+    totalWideIndexBytes += wideBytes;
+    totalIndexBytes += narrowBytes;
+    std::cout << "    indices " << wideBytes << " -> " << narrowBytes << " bytes, "
+              << original.meshes.size() << " -> " << optimized.meshes.size() << " meshes after splitting at "
+              << MESH_SPLIT_VERTICES << " vertices, " << vertexCount(original) << " -> "
+              << vertexCount(optimized) << " vertices" << std::endl;
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        std::cout << "\n    Usage: mesh_report <model>...\n" << std::endl;
+        return -1;
+    }
+    // always measure what Assimp gives, not a previous bake
+    modelPreferBaked = false;
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!report(argv[i]))
+            failed++;
+    }
+    if (totalWideIndexBytes > 0)
+        std::cout << "all indices: " << totalWideIndexBytes << " -> " << totalIndexBytes << " bytes ("
+                  << 100.0 * (1.0 - (double) totalIndexBytes / totalWideIndexBytes) << "% saved)" << std::endl;
+    return failed ? 1 : 0;
+}
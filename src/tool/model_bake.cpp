@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "../model.h"
+
+// Bakes models into "<model>.bmesh" (see baked_model.h), which Model and
+// ModelHandle load instead of the model as long as it is newer:
+//     model_bake ../04_advanced_opengl/model/planet/planet.obj ../04_advanced_opengl/model/rock/rock.obj
+
+uint64_t align16(uint64_t offset) {
+    return (offset + 15) & ~(uint64_t) 15;
+}
+
+uint32_t addString(std::string &strings, std::map<std::string, uint32_t> &offsets, const std::string &s) {
+    auto it = offsets.find(s);
+    if (it != offsets.end())
+        return it->second;
+    uint32_t offset = strings.size();
+    strings.append(s.c_str(), s.size() + 1);
+    offsets[s] = offset;
+    return offset;
+}
+
+void writePadding(FILE *file, uint64_t &written, uint64_t target) {
+    static const char zeros[16] = {0};
+    fwrite(zeros, 1, target - written, file);
+    written = target;
+}
+
+bool bake(const std::string &path) {
+    ModelImporter importer;
+    if (!importer.import(path))
+        return false;
+
+    // tables first, the data offsets depend on their size
+    std::vector<BakedMesh> meshes;
+    std::vector<BakedTexture> textures;
+    std::string strings;
+    std::map<std::string, uint32_t> stringOffsets;
+    for (const MeshData &data : importer.meshes) {
+        BakedMesh mesh = {};
+        mesh.vertexCount = data.vertices.size();
+        mesh.indexCount = data.indices.size();
+        mesh.firstTexture = textures.size();
+        mesh.textureCount = data.textures.size();
+        glm::vec3 boundsMin(0.0f), boundsMax(0.0f);
+        if (!data.vertices.empty()) {
+            boundsMin = boundsMax = data.vertices[0].Position;
+            for (const Vertex &vertex : data.vertices) {
+                boundsMin = glm::min(boundsMin, vertex.Position);
+                boundsMax = glm::max(boundsMax, vertex.Position);
+            }
+        }
+        for (int i = 0; i < 3; i++) {
+            mesh.boundsMin[i] = boundsMin[i];
+            mesh.boundsMax[i] = boundsMax[i];
+        }
+        for (const Texture &texture : data.textures) {
+            BakedTexture baked;
+            baked.type = addString(strings, stringOffsets, texture.type);
+            baked.path = addString(strings, stringOffsets, texture.path.C_Str());
+            textures.push_back(baked);
+        }
+        meshes.push_back(mesh);
+    }
+
+    uint64_t offset = align16(sizeof(BakedHeader) + meshes.size() * sizeof(BakedMesh) +
+                              textures.size() * sizeof(BakedTexture) + strings.size());
+    for (size_t i = 0; i < meshes.size(); i++) {
+        meshes[i].vertexOffset = offset;
+        offset = align16(offset + (uint64_t) meshes[i].vertexCount * sizeof(Vertex));
+        meshes[i].indexOffset = offset;
+        offset = align16(offset + (uint64_t) meshes[i].indexCount * sizeof(unsigned int));
+    }
+
+    BakedHeader header = {};
+    memcpy(header.magic, BAKED_MAGIC, 4);
+    header.version = BAKED_VERSION;
+    header.vertexSize = sizeof(Vertex);
+    header.meshCount = meshes.size();
+    header.textureCount = textures.size();
+    header.stringBytes = strings.size();
+    header.fileSize = offset;
+
+    std::string out = path + ".bmesh";
+    FILE *file = fopen(out.c_str(), "wb");
+    if (!file) {
+        fprintf(stderr, "error: cannot write %s\n", out.c_str());
+        return false;
+    }
+    uint64_t written = 0;
+    written += fwrite(&header, 1, sizeof(header), file);
+    written += fwrite(meshes.data(), 1, meshes.size() * sizeof(BakedMesh), file);
+    written += fwrite(textures.data(), 1, textures.size() * sizeof(BakedTexture), file);
+    written += fwrite(strings.data(), 1, strings.size(), file);
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const MeshData &data = importer.meshes[i];
+        writePadding(file, written, meshes[i].vertexOffset);
+        written += fwrite(data.vertices.data(), 1, data.vertices.size() * sizeof(Vertex), file);
+        writePadding(file, written, meshes[i].indexOffset);
+        written += fwrite(data.indices.data(), 1, data.indices.size() * sizeof(unsigned int), file);
+    }
+    writePadding(file, written, header.fileSize);
+    bool ok = fclose(file) == 0 && written == header.fileSize;
+    if (!ok) {
+        fprintf(stderr, "error: failed writing %s\n", out.c_str());
+        remove(out.c_str());
+        return false;
+    }
+    printf("%s: %u meshes, %u textures, %llu bytes\n", out.c_str(), header.meshCount,
+           header.textureCount, (unsigned long long) header.fileSize);
+    return true;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("\n    Usage: model_bake <model>...\n\n");
+        return -1;
+    }
+    // read the model itself, not a previous bake
+    modelPreferBaked = false;
+    int failed = 0;
+    for (int i = 1; i < argc; i++) {
+        if (!bake(argv[i]))
+            failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,98 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include "../model.h"
+
+// Times Model loading with 1..N texture decoding threads, e.g.
+//     model_load_bench ../04_advanced_opengl/model/planet/planet.obj
+//     model_load_bench ../03_model_loading/model/MT-MIKU/MT-MIKU.pmx 8
+// or Assimp against the .bmesh written by model_bake:
+//     model_load_bench --baked ../04_advanced_opengl/model/*/*.obj
+double loadModel(char *path, ThreadPool *pool) {
+    auto start = std::chrono::steady_clock::now();
+    Model *model = new Model(path, true, pool);
+    // the uploads are only done once the driver has them
+    glFinish();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    // drops the last references, so the next run decodes again
+    delete model;
+    return elapsed.count();
+}
+
+const int BAKED_RUNS = 5;
+
+double averageLoad(char *path, bool baked) {
+    modelPreferBaked = baked;
+    double total = 0.0;
+    for (int i = 0; i < BAKED_RUNS; i++)
+        total += loadModel(path, &threadPool());
+    return total / BAKED_RUNS;
+}
+
+void compareBaked(char *path) {
+    if (bakedModelPath(path).empty()) {
+        std::cout << path << ": no up to date .bmesh, run model_bake first" << std::endl;
+        return;
+    }
+    // holds the textures, so both paths only pay for the geometry
+    modelPreferBaked = false;
+    Model *textures = new Model(path);
+    double assimp = averageLoad(path, false);
+    double baked = averageLoad(path, true);
+    delete textures;
+    std::cout << path << ": Assimp " << assimp << " ms, baked " << baked << " ms ("
+              << assimp / baked << "x)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+    bool baked = argc >= 3 && std::string(argv[1]) == "--baked";
+    if (!baked && (argc < 2 || argc > 3)) {
+        std::cout << "\n    Usage: model_load_bench <model> [maxThreads]"
+                  << "\n           model_load_bench --baked <model>...\n" << std::endl;
+        return -1;
+    }
+    unsigned int maxThreads = !baked && argc == 3 ? atoi(argv[2]) : ThreadPool::defaultThreads();
+
+    glfwInit();
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(64, 64, "model_load_bench", NULL, NULL);
+    if (window == NULL) {
+        std::cout << "Failed to create GLFW window" << std::endl;
+        glfwTerminate();
+        return -1;
+    }
+    glfwMakeContextCurrent(window);
+    if (!gladLoadGLLoader((GLADloadproc) glfwGetProcAddress)) {
+        std::cout << "Failed to initialize GLAD" << std::endl;
+        return -1;
+    }
+
+    if (baked) {
+        for (int i = 2; i < argc; i++)
+            compareBaked(argv[i]);
+        glfwTerminate();
+        return 0;
+    }
+
+    // warm the page cache so every run reads the files from memory
+    loadModel(argv[1], NULL);
+
+    double serial = loadModel(argv[1], NULL);
+    std::cout << "serial: " << serial << " ms" << std::endl;
+    for (unsigned int threads = 1; threads <= maxThreads; threads++) {
+        // the calling thread decodes too, so `threads` counts it
+        std::unique_ptr<ThreadPool> pool(threads > 1 ? new ThreadPool(threads - 1) : NULL);
+        double ms = loadModel(argv[1], pool.get());
+        std::cout << threads << " threads: " << ms << " ms (" << serial / ms << "x)" << std::endl;
+    }
+    textureCache().printStats("in total");
+
+    glfwTerminate();
+    return 0;
+}
@@ -0,0 +1,140 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include "../model.h"
+
+// Converts a synthetic mesh (10M vertices by default) from Assimp's arrays
+// to interleaved Vertex data, the old way and with convertVertices() /
+// convertIndices(), and checks both give the same bytes:
+//     vertex_convert_bench [vertices] [meshes]
+
+// what processMesh used to do
+void convertVerticesOld(const aiMesh *mesh, vector<Vertex> &vertices) {
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++) {
+        Vertex vertex;
+        glm::vec3 vector;
+        vector.x = mesh->mVertices[i].x;
+        vector.y = mesh->mVertices[i].y;
+        vector.z = mesh->mVertices[i].z;
+        vertex.Position = vector;
+        vector.x = mesh->mNormals[i].x;
+        vector.y = mesh->mNormals[i].y;
+        vector.z = mesh->mNormals[i].z;
+        vertex.Normal = vector;
+        if (mesh->mTextureCoords[0]) {
+            glm::vec2 vec;
+            vec.x = mesh->mTextureCoords[0][i].x;
+            vec.y = mesh->mTextureCoords[0][i].y;
+            vertex.TexCoords = vec;
+        } else {
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        }
+        vertices.push_back(vertex);
+    }
+}
+
+void convertIndicesOld(const aiMesh *mesh, vector<unsigned int> &indices) {
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        aiFace face = mesh->mFaces[i];
+        for (unsigned int j = 0; j < face.mNumIndices; j++)
+            indices.push_back(face.mIndices[j]);
+    }
+}
+
+float randomFloat() {
+    return rand() / (float) RAND_MAX * 2.0f - 1.0f;
+}
+
+// owned by the aiMesh, like Assimp's own
+aiMesh *syntheticMesh(unsigned int vertices) {
+    aiMesh *mesh = new aiMesh();
+    mesh->mNumVertices = vertices;
+    mesh->mVertices = new aiVector3D[vertices];
+    mesh->mNormals = new aiVector3D[vertices];
+    for (int i = 0; i < AI_MAX_NUMBER_OF_TEXTURECOORDS; i++)
+        mesh->mTextureCoords[i] = NULL;
+    mesh->mTextureCoords[0] = new aiVector3D[vertices];
+    for (unsigned int i = 0; i < vertices; i++) {
+        mesh->mVertices[i].x = randomFloat();
+        mesh->mVertices[i].y = randomFloat();
+        mesh->mVertices[i].z = randomFloat();
+        mesh->mNormals[i].x = randomFloat();
+        mesh->mNormals[i].y = randomFloat();
+        mesh->mNormals[i].z = randomFloat();
+        mesh->mTextureCoords[0][i].x = randomFloat();
+        mesh->mTextureCoords[0][i].y = randomFloat();
+        mesh->mTextureCoords[0][i].z = 0.0f;
+    }
+    mesh->mNumFaces = vertices / 3;
+    mesh->mFaces = new aiFace[mesh->mNumFaces];
+    mesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+    for (unsigned int i = 0; i < mesh->mNumFaces; i++) {
+        mesh->mFaces[i].mNumIndices = 3;
+        mesh->mFaces[i].mIndices = new unsigned int[3];
+        for (int j = 0; j < 3; j++)
+            mesh->mFaces[i].mIndices[j] = rand() % vertices;
+    }
+    return mesh;
+}
+
+template <typename F>
+double measure(F &&fn) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+int main(int argc, char **argv) {
+    unsigned int total = argc > 1 ? atoi(argv[1]) : 10000000;
+    unsigned int meshCount = argc > 2 ? atoi(argv[2]) : 16;
+    if (total == 0 || meshCount == 0 || meshCount > total) {
+        std::cout << "\n    Usage: vertex_convert_bench [vertices] [meshes]\n" << std::endl;
+        return -1;
+    }
+    // aiMesh's destructor frees the arrays and faces
+    std::vector<std::unique_ptr<aiMesh>> meshes;
+    for (unsigned int i = 0; i < meshCount; i++)
+        meshes.emplace_back(syntheticMesh(total / meshCount));
+
+    std::vector<std::vector<Vertex>> oldVertices(meshCount), newVertices(meshCount);
+    std::vector<std::vector<unsigned int>> oldIndices(meshCount), newIndices(meshCount);
+    double oldMs = measure([&] {
+        for (unsigned int i = 0; i < meshCount; i++) {
+            convertVerticesOld(meshes[i].get(), oldVertices[i]);
+            convertIndicesOld(meshes[i].get(), oldIndices[i]);
+        }
+    });
+    double newMs = measure([&] {
+        for (unsigned int i = 0; i < meshCount; i++) {
+            convertVertices(meshes[i].get(), newVertices[i]);
+            convertIndices(meshes[i].get(), newIndices[i]);
+        }
+    });
+    for (unsigned int i = 0; i < meshCount; i++) {
+        if (oldVertices[i].size() != newVertices[i].size() || oldIndices[i] != newIndices[i] ||
+            memcmp(oldVertices[i].data(), newVertices[i].data(), oldVertices[i].size() * sizeof(Vertex)) != 0) {
+            std::cout << "error: mesh " << i << " differs" << std::endl;
+            return 1;
+        }
+        std::vector<Vertex>().swap(newVertices[i]);
+        std::vector<unsigned int>().swap(newIndices[i]);
+    }
+    ThreadPool &pool = threadPool();
+    double parallelMs = measure([&] {
+        pool.parallelFor(meshCount, [&](size_t i) {
+            convertVertices(meshes[i].get(), newVertices[i]);
+            convertIndices(meshes[i].get(), newIndices[i]);
+        });
+    });
+
+    std::cout << meshCount << " meshes, " << total / meshCount * meshCount << " vertices" << std::endl;
+    std::cout << "per vertex push_back: " << oldMs << " ms" << std::endl;
+    std::cout << "bulk:                 " << newMs << " ms (" << oldMs / newMs << "x)" << std::endl;
+    std::cout << "bulk, " << pool.size() << " threads:     " << parallelMs << " ms ("
+              << oldMs / parallelMs << "x)" << std::endl;
+    return 0;
+}
@@ -1,114 +0,0 @@
-#ifndef MESH_H
-#define MESH_H
-
-#include <iostream>
-#include <string>
-#include <vector>
-#include <glad/glad.h>
-#include <GLFW/glfw3.h>
-#include "../shader_s.h"
-#include <glm/glm.hpp>
-#include <glm/gtc/matrix_transform.hpp>
-#include <glm/gtc/type_ptr.hpp>
-#include <assimp/postprocess.h>
-
-using namespace std;
-
-struct Vertex {
-    glm::vec3 Position;
-    glm::vec3 Normal;
-    glm::vec2 TexCoords;
-};
-
-struct Texture {
-    unsigned int id;
-    string type;
-    aiString path;
-};
-
-class Mesh {
-public:
-
-    /*  网格数据  */
-
-    vector<Vertex> vertices;
-    vector<unsigned int> indices;
-    vector<Texture> textures;
-
-    /*  函数  */
-
-    Mesh(vector<Vertex> vertices, vector<unsigned int> indices,
-        vector<Texture> textures) {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
-        setupMesh();
-    }
-
-    void draw(Shader shader) {
-        unsigned int diffuseNr = 1;
-        unsigned int specularNr = 1;
-        for(unsigned int i = 0; i < textures.size(); i++) {
-            glActiveTexture(GL_TEXTURE0 + i); // 在绑定之前激活相应的纹理单元
-            // 获取纹理序号（diffuse_textureN 中的 N）
-            string number;
-            string name = textures[i].type;
-            if(name == "texture_diffuse")
-                number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++);
-            if (number[0] != '1')
-                std::cout << name + number << std::endl;
-            shader.setInt("material." + name + number, i);
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
-        }
-        glActiveTexture(GL_TEXTURE0);
-
-        // 绘制网格
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-    }
-
-    GLuint getVaoName() {
-        return VAO;
-    }
-
-private:
-
-    /*  渲染数据  */
-
-    unsigned int VAO, VBO, EBO;
-
-    /*  函数  */
-
-    void setupMesh() {
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
-
-        glBindVertexArray(VAO);
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);  
-
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), 
-                    &indices[0], GL_STATIC_DRAW);
-
-        // 顶点位置
-        glEnableVertexAttribArray(0);   
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // 顶点法线
-        glEnableVertexAttribArray(1);   
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
-        // 顶点纹理坐标
-        glEnableVertexAttribArray(2);   
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
-
-        glBindVertexArray(0);
-    }
-};
-
-#endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -7,16 +8,39 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
-#include "mesh.h"
-#include "model.h"
+#include "../mesh.h"
+#include "../model.h"
+#include "../model_stream.h"
 
 #include "../camera.h"
+#include "../frame_uniforms.h"
+#include "../shader_variants.h"
 #include "vertex_data_textures.h"
+#ifdef PRINT_ALLOC_STATS
+#include "../alloc_stats.h"
+#endif
+#ifdef PRINT_MEMORY_STATS
+#include "../mem_stats.h"
+#endif
+#ifdef PRINT_FRAME_TRACE
+#include <cstdio>
+#endif
 
 int screenWidth = 1280, screenHeight = 720;
 
+// one program per light count / specular map combination
+ShaderVariants* lightingShaders = nullptr;
+ShaderDefines lightingDefines;
 Shader* lightingShader = nullptr;
+Shader* lightingNoSpecularShader = nullptr;
 Shader* lampShader = nullptr;
+FrameUniforms* frameUniforms = nullptr;
+// Build with -DMODEL_PACKED_VERTICES for 16 byte vertices, decoded in model.vs
+#ifdef MODEL_PACKED_VERTICES
+const VertexFormat vertexFormat = VERTEX_PACKED;
+#else
+const VertexFormat vertexFormat = VERTEX_FLOAT;
+#endif
 
 unsigned int VBO;
 unsigned int lightVAO;
@@ -25,7 +49,11 @@ float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
 Camera* camera = nullptr;
-Model* model = nullptr;
+ModelHandle* model = nullptr;
+bool modelReported = false;
+#ifdef PRINT_TEXTURE_STATS
+double loadStart = 0.0;
+#endif
 float lastX = screenWidth / 2;
 float lastY = screenHeight / 2;
 bool firstMouse = true;
@@ -37,13 +65,66 @@ std::vector<glm::vec3> pointLightPositions = {
 
 void prepareDraw() {
     // Create shader
-    lightingShader = new Shader("shader/model.vs", "shader/model.fs");
+    lightingShaders = new ShaderVariants("shader/model.vs", "shader/model.fs");
     lampShader = new Shader("shader/colors.vs", "shader/colors_light.fs");
 
+    // Lighting
+    float dirAmbient = 1.0f;
+    float pointAmbient = dirAmbient;
+
+    float dirDiffuse = 0.0f;
+    float pointDiffuse = dirDiffuse;
+
+    float dirSpec = 0.0f;
+    float pointSpec = dirSpec;
+
+    // Shared camera & light uniforms, only the spot light follows the camera
+    frameUniforms = new FrameUniforms();
+    lightingShaders->setup = [](Shader &shader) {
+        frameUniforms->attach(shader);
+        shader.use();
+        shader.setFloat("material.shininess", 64.0f);
+    };
+    frameUniforms->attach(*lampShader);
+    frameUniforms->setDirLight(glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3(dirAmbient),
+                               glm::vec3(dirDiffuse), glm::vec3(dirSpec));
+    // the Lights block holds at most FRAME_MAX_POINT_LIGHTS
+    size_t pointCount = std::min(pointLightPositions.size(), (size_t) FRAME_MAX_POINT_LIGHTS);
+    frameUniforms->lights.pointCount = pointCount;
+    for (size_t i = 0; i < pointCount; i++) {
+        frameUniforms->setPointLight(i, pointLightPositions[i], glm::vec3(pointAmbient),
+                                     glm::vec3(pointDiffuse), glm::vec3(pointSpec),
+                                     1.0f, 0.09f, 0.032f);
+    }
+
+    // The light count is fixed for this scene, compile it into the shader
+    lightingDefines.set("NUM_POINT_LIGHTS", (int) pointCount);
+    lightingDefines.set("PACKED_VERTICES", vertexFormat == VERTEX_PACKED ? 1 : 0);
+    lightingShaders->prewarm({
+        ShaderDefines(lightingDefines).set("HAS_SPECULAR_MAP", 1),
+        ShaderDefines(lightingDefines).set("HAS_SPECULAR_MAP", 0)
+    });
+    // resolved once, the draw loop only needs the two programs
+    lightingShader = &lightingShaders->get(ShaderDefines(lightingDefines).set("HAS_SPECULAR_MAP", 1));
+    lightingNoSpecularShader = &lightingShaders->get(ShaderDefines(lightingDefines).set("HAS_SPECULAR_MAP", 0));
+
     // Load model
     // model/gennso/gennso.pmx
     // model/MT-MIKU/MT-MIKU.pmx
-    model = new Model("model/rin/Black.pmx");
+    // build with -DMESH_GPU_RESIDENT to keep the meshes in video memory only
+#ifdef PRINT_MEMORY_STATS
+    printResidentSet("before loading model");
+#endif
+#ifdef PRINT_TEXTURE_STATS
+    loadStart = glfwGetTime();
+#endif
+    // Streams in while the scene renders, placeholders stand in for missing meshes
+    model = new ModelHandle("model/rin/Black.pmx", 4 << 20, MODEL_KEEP_CPU_DATA, &threadPool(),
+                            MODEL_OPTIMIZE_MESHES, vertexFormat);
+#ifdef MODEL_NO_STREAMING
+    // the old behaviour: nothing is drawn until the whole model is uploaded
+    model->finish();
+#endif
 
     // Create camera
     camera = new Camera(glm::vec3(1.0f, 1.0f, 5.0f));
@@ -61,69 +142,76 @@ void prepareDraw() {
     glEnableVertexAttribArray(0);
 }
 
-void drawStaff() {
-    lightingShader->use();
+// once the last mesh is uploaded
+void modelLoaded() {
+#ifdef PRINT_TEXTURE_STATS
+    // Build with -DTEXTURE_NO_CACHE to compare against decoding every material's textures
+    std::cout << "Model loaded in " << (glfwGetTime() - loadStart) * 1000.0 << " ms" << std::endl;
+    textureCache().printStats("for the model");
+#endif
+#ifdef PRINT_MEMORY_STATS
+    printResidentSet("after loading model");
+    std::cout << "Mesh data kept in memory: " << model->get()->cpuBytes() << " bytes" << std::endl;
+    std::cout << "Mesh data in video memory: " << model->get()->gpuBytes() << " bytes" << std::endl;
+#endif
+}
 
+void drawStaff() {
     // Projection matrix
     glm::mat4 projection;
     projection = glm::perspective(glm::radians(camera->zoom), (float) screenWidth / screenHeight, 0.1f, 100.0f);
 
-    // Pass the transform matrixs
-    lightingShader->setMat4("view", camera->getViewMatrix());
-    lightingShader->setMat4("projection", projection);
-
-    // Lighting
-    float dirAmbient = 1.0f;
-    float pointAmbient = dirAmbient;
-    float spotAmbient = dirAmbient;
-
-    float dirDiffuse = 0.0f;
-    float pointDiffuse = dirDiffuse;
-    float spotDiffuse = dirDiffuse;
-
-    float dirSpec = 0.0f;
-    float pointSpec = dirSpec;
-    float spotSpec = dirSpec;
-
-    lightingShader->setVec3("viewPos", camera->position);
-
-    lightingShader->setVec3("dirLight.ambient",  dirAmbient, dirAmbient, dirAmbient);
-    lightingShader->setVec3("dirLight.diffuse",  dirDiffuse, dirDiffuse, dirDiffuse);
-    lightingShader->setVec3("dirLight.specular", dirSpec, dirSpec, dirSpec);
-    lightingShader->setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-
-    lightingShader->setInt("pointCount", pointLightPositions.size());
-    for (int i = 0; i < 4; i++) {
-        std::string uni_name = "pointLights[" + std::to_string(i) + "]";
-        lightingShader->setVec3(uni_name + ".ambient",  pointAmbient, pointAmbient, pointAmbient);
-        lightingShader->setVec3(uni_name + ".diffuse",  pointDiffuse, pointDiffuse, pointDiffuse);
-        lightingShader->setVec3(uni_name + ".specular", pointSpec, pointSpec, pointSpec);
-        lightingShader->setVec3(uni_name + ".position", pointLightPositions[i]);
-        lightingShader->setFloat(uni_name + ".constant",  1.0f);
-        lightingShader->setFloat(uni_name + ".linear",    0.09f);
-        lightingShader->setFloat(uni_name + ".quadratic", 0.032f);
-    }
-
-    lightingShader->setVec3("spotLight.ambient",  spotAmbient, spotAmbient, spotAmbient);
-    lightingShader->setVec3("spotLight.diffuse",  spotDiffuse, spotDiffuse, spotDiffuse);
-    lightingShader->setVec3("spotLight.specular", spotSpec, spotSpec, spotSpec);
-    lightingShader->setVec3("spotLight.position",  camera->position);
-    lightingShader->setVec3("spotLight.direction", camera->front);
-    lightingShader->setFloat("spotLight.cutOff",   glm::cos(glm::radians(12.5f)));
-    lightingShader->setFloat("spotLight.outerCutOff",   glm::cos(glm::radians(17.5f)));
-    lightingShader->setFloat("spotLight.constant",  1.0f);
-    lightingShader->setFloat("spotLight.linear",    0.09f);
-    lightingShader->setFloat("spotLight.quadratic", 0.032f);
-
-    // Material
-    lightingShader->setFloat("material.shininess", 64.0f);
+    // Camera & lighting, one buffer update for both programs
+    float spotAmbient = 1.0f;
+    float spotDiffuse = 0.0f;
+    float spotSpec = 0.0f;
+    frameUniforms->setCamera(camera->getViewMatrix(), projection, camera->position);
+    frameUniforms->setSpotLight(camera->position, camera->front,
+                                glm::cos(glm::radians(12.5f)), glm::cos(glm::radians(17.5f)),
+                                glm::vec3(spotAmbient), glm::vec3(spotDiffuse), glm::vec3(spotSpec),
+                                1.0f, 0.09f, 0.032f);
+    frameUniforms->upload();
 
     // Drawing
     glm::mat4 modelMat = glm::mat4(1.0f);
     modelMat = glm::translate(modelMat, glm::vec3(0.0f, -1.75f, 0.0f)); // translate it down so it's at the center of the scene
     modelMat = glm::scale(modelMat, glm::vec3(0.2f, 0.2f, 0.2f));
-    lightingShader->setMat4("model", modelMat);
-    model->draw(*lightingShader);
+    // Model matrix, on both variants the meshes may pick
+    for (Shader *shader : {lightingShader, lightingNoSpecularShader}) {
+        shader->use();
+        shader->setMat4("model", modelMat);
+    }
+    // Runs of meshes sharing state in one multi-draw each, meshes out of view skipped;
+    // -DMODEL_NO_INDIRECT draws mesh by mesh, -DMODEL_NO_CULLING draws them all
+    Frustum frustum(projection * camera->getViewMatrix() * modelMat);
+#if defined(MODEL_NO_INDIRECT) && defined(MODEL_NO_CULLING)
+    model->draw(*lightingShader, *lightingNoSpecularShader);
+#elif defined(MODEL_NO_INDIRECT)
+    model->draw(*lightingShader, *lightingNoSpecularShader, frustum);
+#elif defined(MODEL_NO_CULLING)
+    model->drawIndirect(*lightingShader, *lightingNoSpecularShader);
+#else
+    model->drawIndirect(*lightingShader, *lightingNoSpecularShader, frustum);
+#endif
+
+    // Wireframe boxes where meshes are still loading
+    bool placeholders = false;
+    model->forEachPlaceholder([&](const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+        if (!placeholders) {
+            lampShader->use();
+            glBindVertexArray(lightVAO);
+            glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+            placeholders = true;
+        }
+        glm::mat4 boxMat = glm::translate(modelMat, (boundsMin + boundsMax) * 0.5f);
+        boxMat = glm::scale(boxMat, glm::max(boundsMax - boundsMin, glm::vec3(0.001f)));
+        lampShader->setMat4("model", boxMat);
+        glDrawArrays(GL_TRIANGLES, 0, 36);
+    });
+    if (placeholders) {
+        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        glBindVertexArray(0);
+    }
 
     // Lamp cube
     // lampShader->use();
@@ -133,8 +221,6 @@ void drawStaff() {
     //     modelMat = glm::translate(modelMat, pointLightPositions[i]);
     //     modelMat = glm::scale(modelMat, glm::vec3(0.2f));
     //     lampShader->setMat4("model", modelMat);
-    //     lampShader->setMat4("view", camera->getViewMatrix());
-    //     lampShader->setMat4("projection", projection);
 
     //     glBindVertexArray(lightVAO);
     //     glDrawArrays(GL_TRIANGLES, 0, 36);
@@ -191,30 +277,91 @@ int main() {
     // Prepare for drawing
     prepareDraw();
     
+#ifdef PRINT_FRAME_TRACE
+    // Build with -DMODEL_NO_STREAMING to compare against loading before the first frame
+    FILE *trace = fopen("frame_trace.csv", "w");
+    fprintf(trace, "frame,time_ms,frame_ms,stream_ms,stream_bytes,meshes_ready,meshes_total\n");
+    double traceLast = glfwGetTime();
+    double worstStreaming = 0.0, worstAfter = 0.0;
+    int frame = 0;
+#endif
+
     // Start render loop
     while (!glfwWindowShouldClose(window)) {
         // Input
         processInput(window);
+        // Pick up edited shader files
+        shaderReloader().update();
+        // Upload the next part of the model
+#ifdef PRINT_FRAME_TRACE
+        bool streaming = !model->ready();
+#endif
+        model->update();
+        if (model->ready() && !modelReported) {
+            modelReported = true;
+            modelLoaded();
+        }
 
         // Clear Screen
         glClearColor(1.0f, 1.0f, 0.7f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // Draw
+#ifdef PRINT_ALLOC_STATS
+        unsigned long allocations = heapAllocations;
+#endif
         drawStaff();
+#ifdef PRINT_ALLOC_STATS
+        // Strings included: the draw path resolves every name at load time
+        std::cout << "Heap allocations in drawStaff: " << heapAllocations - allocations << std::endl;
+#endif
+#ifdef PRINT_BIND_STATS
+        // Build with -DMESH_NO_ARENA or -DMODEL_NO_INDIRECT to compare against the per mesh paths
+        std::cout << "Per frame: " << meshDrawStats.vertexArrayBinds << " VAO binds, "
+                  << meshDrawStats.textureBinds << " texture binds, " << meshDrawStats.drawCalls
+                  << " draw calls, " << meshDrawStats.meshesVisible << " meshes visible, "
+                  << meshDrawStats.meshesCulled << " culled" << std::endl;
+        meshDrawStats = MeshDrawStats();
+#endif
 
         // Frame calc
         float currentFrame = glfwGetTime();
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
 
+#ifdef PRINT_UNIFORM_STATS
+        // Build with -DSHADER_NO_UNIFORM_CACHE to compare against the old path
+        std::cout << "glGetUniformLocation calls per frame: " << shaderLocationQueries << std::endl;
+        shaderLocationQueries = 0;
+#endif
+
         // Swap double buffer
         glfwSwapBuffers(window);
         // Deal with the events
         glfwPollEvents();    
+
+#ifdef PRINT_FRAME_TRACE
+        double traceNow = glfwGetTime();
+        double frameMs = (traceNow - traceLast) * 1000.0;
+        traceLast = traceNow;
+        fprintf(trace, "%d,%.3f,%.3f,%.3f,%zu,%zu,%zu\n", frame++, traceNow * 1000.0, frameMs,
+                model->lastFrame.ms, model->lastFrame.bytes, model->readyMeshes(), model->totalMeshes());
+        if (streaming)
+            worstStreaming = std::max(worstStreaming, frameMs);
+        else
+            worstAfter = std::max(worstAfter, frameMs);
+#endif
     }
 
-    delete lightingShader;
+#ifdef PRINT_FRAME_TRACE
+    fclose(trace);
+    std::cout << "Frame trace written to frame_trace.csv, longest frame while streaming "
+              << worstStreaming << " ms, afterwards " << worstAfter << " ms" << std::endl;
+#endif
+
+    delete model;
+    delete frameUniforms;
+    delete lightingShaders;
     glfwTerminate();
     return 0;
 }
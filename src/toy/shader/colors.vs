@@ -2,8 +2,8 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "frame_uniforms.glsl"
 
 void main() {
     gl_Position = projection * view * model * vec4(aPos, 1.0);
@@ -1,7 +1,5 @@
 #version 330 core
 
-#define NR_POINT_LIGHTS 10
-
 struct Material {
     sampler2D texture_diffuse1;
     sampler2D texture_diffuse2;
@@ -11,40 +9,13 @@ struct Material {
     float     shininess;
 };
 
-struct DirLight {
-    vec3 direction;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct PointLight {
-    vec3 position;
-
-    float constant;
-    float linear;
-    float quadratic;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-};
-
-struct SpotLight {
-    vec3 position;
-    vec3 direction;
-    float cutOff;
-    float outerCutOff;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+#include "frame_uniforms.glsl"
 
-    float constant;
-    float linear;
-    float quadratic;
-};
+// 编译期配置，由 ShaderVariants 注入
+// NUM_POINT_LIGHTS: 点光源数量，未定义时按 pointCount 循环
+#ifndef HAS_SPECULAR_MAP
+#define HAS_SPECULAR_MAP 1
+#endif
 
 in vec3 Normal;
 in vec3 FragPos;
@@ -52,12 +23,7 @@ in vec2 TexCoords;
 
 out vec4 FragColor;
 
-uniform vec3 viewPos;
 uniform Material material;
-uniform DirLight dirLight;
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform SpotLight spotLight;
-uniform int pointCount;
 
 vec4 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
 
@@ -65,6 +31,14 @@ vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
 vec4 CalcSpotLight(SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 
+vec4 SpecularMap() {
+#if HAS_SPECULAR_MAP
+    return texture(material.texture_specular1, TexCoords);
+#else
+    return vec4(0.0);
+#endif
+}
+
 void main() {
     // 属性
     vec3 norm = normalize(Normal);
@@ -72,10 +46,14 @@ void main() {
 
     // 第一阶段：定向光照
     vec4 result = CalcDirLight(dirLight, norm, viewDir);
-    // // 第二阶段：点光源
-    // for (int i = 0; i < pointCount; i++) {
-    //     result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
-    // }
+    // 第二阶段：点光源
+#ifdef NUM_POINT_LIGHTS
+    for (int i = 0; i < NUM_POINT_LIGHTS; i++) {
+#else
+    for (int i = 0; i < pointCount; i++) {
+#endif
+        result += CalcPointLight(pointLights[i], norm, FragPos, viewDir);
+    }
     // // 第三阶段：聚光
     // result += CalcSpotLight(spotLight, norm, FragPos, viewDir);
 
@@ -92,7 +70,7 @@ vec4 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir) {
     // 合并结果
     vec4 ambient  = vec4(light.ambient, 1.0) * texture(material.texture_diffuse1, TexCoords);
     vec4 diffuse  = vec4(light.diffuse, 1.0)  * diff * texture(material.texture_diffuse1, TexCoords);
-    vec4 specular = vec4(light.specular, 1.0) * spec * texture(material.texture_specular1, TexCoords);
+    vec4 specular = vec4(light.specular, 1.0) * spec * SpecularMap();
     return ambient; // (ambient + diffuse + specular);
 }
 
@@ -110,7 +88,7 @@ vec4 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir) {
     // 合并结果
     vec4 ambient  = vec4(light.ambient, 1.0) * texture(material.texture_diffuse1, TexCoords);
     vec4 diffuse  = vec4(light.diffuse, 1.0)  * diff * texture(material.texture_diffuse1, TexCoords);
-    vec4 specular = vec4(light.specular, 1.0) * spec * texture(material.texture_specular1, TexCoords);
+    vec4 specular = vec4(light.specular, 1.0) * spec * SpecularMap();
     ambient  *= attenuation;
     diffuse  *= attenuation;
     specular *= attenuation;
@@ -131,7 +109,7 @@ vec4 CalcSpotLight(SpotLight light, vec3 norm, vec3 fragPos, vec3 viewDir) {
     float specularStrength = 0.5;
     vec3 reflectDir = reflect(-lightDir, norm);
     float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
-    vec4 specular = vec4(light.specular, 1.0) * spec * texture(material.texture_specular1, TexCoords);
+    vec4 specular = vec4(light.specular, 1.0) * spec * SpecularMap();
 
     // Attenuation
     float distance    = length(light.position - fragPos);
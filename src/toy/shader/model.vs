@@ -1,6 +1,17 @@
 #version 330 core
+
+// 编译期配置，由 ShaderVariants 注入
+// PACKED_VERTICES: 1 时输入为 16 字节的压缩顶点（vertex_format.h 的 PackedVertex）
+#ifndef PACKED_VERTICES
+#define PACKED_VERTICES 0
+#endif
+
 layout (location = 0) in vec3 aPos;
+#if PACKED_VERTICES
+layout (location = 1) in vec2 aNormal;
+#else
 layout (location = 1) in vec3 aNormal;
+#endif
 layout (location = 2) in vec2 aTexCoords;
 
 out vec3 Normal;
@@ -8,12 +19,35 @@ out vec3 FragPos;
 out vec2 TexCoords;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+#include "frame_uniforms.glsl"
+
+#if PACKED_VERTICES
+// 网格包围盒，aPos 是其中的 0..1
+uniform vec3 packedBoundsMin;
+uniform vec3 packedBoundsExtent;
+
+// 与 vertex_format.h 的 octahedralDecode() 一致
+vec3 octahedralDecode(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        vec2 signs = vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        n.xy = (1.0 - abs(n.yx)) * signs;
+    }
+    return normalize(n);
+}
+#endif
 
 void main() {
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
-    FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;
+#if PACKED_VERTICES
+    vec3 position = packedBoundsMin + aPos * packedBoundsExtent;
+    vec3 normal = octahedralDecode(aNormal);
+#else
+    vec3 position = aPos;
+    vec3 normal = aNormal;
+#endif
+    gl_Position = projection * view * model * vec4(position, 1.0);
+    FragPos = vec3(model * vec4(position, 1.0));
+    Normal = mat3(transpose(inverse(model))) * normal;
     TexCoords = aTexCoords;
-}
\ No newline at end of file
+}
@@ -0,0 +1,198 @@
+#ifndef VERTEX_FORMAT_H
+#define VERTEX_FORMAT_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/**
+ * The vertex layouts a Mesh can keep in its vertex buffer.
+ *
+ * VERTEX_FLOAT is the plain 32 byte Vertex. VERTEX_PACKED is a 16 byte
+ * PackedVertex:
+ *
+ *     position   3 x unorm16 within the mesh's bounds, 2 bytes padding
+ *     normal     octahedral, 2 x snorm16
+ *     texcoords  2 x half float
+ *
+ * The bounds go to the shader as uniforms (packedBoundsMin/Extent, see
+ * PACKED_VERTICES in toy/shader/model.vs), which scales positions back and
+ * decodes the normal. Positions are off by at most 1/131070 of the bounds
+ * per axis, normals by a few thousandths of a degree, texture coordinates
+ * keep 11 significant bits. measurePackingError() gives the real figures
+ * for a mesh.
+ */
+
+struct Vertex {
+    glm::vec3 Position;
+    glm::vec3 Normal;
+    glm::vec2 TexCoords;
+};
+
+enum VertexFormat {
+    VERTEX_FLOAT,
+    VERTEX_PACKED
+};
+
+struct PackedVertex {
+    uint16_t Position[4];
+    uint32_t Normal;
+    uint32_t TexCoords;
+};
+
+static_assert(sizeof(PackedVertex) == 16, "PackedVertex layout changed");
+
+size_t vertexSize(VertexFormat format) {
+    return format == VERTEX_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+// attributes 0-2 of the bound VAO, reading the bound GL_ARRAY_BUFFER from its start
+void setupVertexAttributes(VertexFormat format) {
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glEnableVertexAttribArray(2);
+    if (format == VERTEX_PACKED) {
+        GLsizei stride = sizeof(PackedVertex);
+        glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, Position));
+        glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, stride, (void*)offsetof(PackedVertex, Normal));
+        glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(PackedVertex, TexCoords));
+    } else {
+        GLsizei stride = sizeof(Vertex);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, Position));
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, Normal));
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)offsetof(Vertex, TexCoords));
+    }
+}
+
+// a unit vector folded onto the octahedron |x| + |y| + |z| = 1 and flattened to [-1, 1]^2
+glm::vec2 octahedralEncode(const glm::vec3 &n) {
+    float sum = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    // missing normals stay missing-ish: (0, 0) decodes to +z
+    if (sum == 0.0f)
+        return glm::vec2(0.0f);
+    glm::vec2 e(n.x / sum, n.y / sum);
+    if (n.z < 0.0f) {
+        glm::vec2 sign(e.x >= 0.0f ? 1.0f : -1.0f, e.y >= 0.0f ? 1.0f : -1.0f);
+        e = (1.0f - glm::abs(glm::vec2(e.y, e.x))) * sign;
+    }
+    return e;
+}
+
+// the same as octahedralDecode() in the shader
+glm::vec3 octahedralDecode(const glm::vec2 &e) {
+    glm::vec3 n(e.x, e.y, 1.0f - std::abs(e.x) - std::abs(e.y));
+    if (n.z < 0.0f) {
+        glm::vec2 sign(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+        glm::vec2 folded = (1.0f - glm::abs(glm::vec2(n.y, n.x))) * sign;
+        n.x = folded.x;
+        n.y = folded.y;
+    }
+    return glm::normalize(n);
+}
+
+// bounds as the mesh records them; a flat axis packs to 0
+void packVertices(const Vertex *vertices, size_t count, const glm::vec3 &boundsMin,
+                  const glm::vec3 &boundsMax, PackedVertex *out) {
+    glm::vec3 extent = boundsMax - boundsMin;
+    glm::vec3 scale(0.0f);
+    for (int axis = 0; axis < 3; axis++)
+        if (extent[axis] > 0.0f)
+            scale[axis] = 65535.0f / extent[axis];
+    for (size_t i = 0; i < count; i++) {
+        const Vertex &vertex = vertices[i];
+        PackedVertex &packed = out[i];
+        glm::vec3 q = glm::clamp((vertex.Position - boundsMin) * scale + 0.5f, 0.0f, 65535.0f);
+        packed.Position[0] = (uint16_t) q.x;
+        packed.Position[1] = (uint16_t) q.y;
+        packed.Position[2] = (uint16_t) q.z;
+        packed.Position[3] = 0;
+        packed.Normal = glm::packSnorm2x16(octahedralEncode(vertex.Normal));
+        packed.TexCoords = glm::packHalf2x16(vertex.TexCoords);
+    }
+}
+
+// what the shader reconstructs
+Vertex unpackVertex(const PackedVertex &packed, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+    Vertex vertex;
+    glm::vec3 q(packed.Position[0], packed.Position[1], packed.Position[2]);
+    vertex.Position = boundsMin + q / 65535.0f * (boundsMax - boundsMin);
+    vertex.Normal = octahedralDecode(glm::unpackSnorm2x16(packed.Normal));
+    vertex.TexCoords = glm::unpackHalf2x16(packed.TexCoords);
+    return vertex;
+}
+
+/**
+ * How far packed vertices land from the originals: positions in model
+ * units, normals in degrees (zero normals skipped), texture coordinates in
+ * UV units. Sums are kept so several meshes can be merged.
+ */
+struct PackingError {
+    size_t vertices = 0;
+    size_t normals = 0;
+    double positionMax = 0.0, positionSum = 0.0;
+    double normalMax = 0.0, normalSum = 0.0;
+    double texCoordMax = 0.0, texCoordSum = 0.0;
+
+    double positionMean() const {
+        return vertices ? positionSum / vertices : 0.0;
+    }
+
+    double normalMean() const {
+        return normals ? normalSum / normals : 0.0;
+    }
+
+    double texCoordMean() const {
+        return vertices ? texCoordSum / vertices : 0.0;
+    }
+
+    PackingError &operator+=(const PackingError &other) {
+        vertices += other.vertices;
+        normals += other.normals;
+        positionMax = std::max(positionMax, other.positionMax);
+        positionSum += other.positionSum;
+        normalMax = std::max(normalMax, other.normalMax);
+        normalSum += other.normalSum;
+        texCoordMax = std::max(texCoordMax, other.texCoordMax);
+        texCoordSum += other.texCoordSum;
+        return *this;
+    }
+};
+
+PackingError measurePackingError(const Vertex *vertices, size_t count) {
+    PackingError error;
+    if (count == 0)
+        return error;
+    glm::vec3 boundsMin = vertices[0].Position, boundsMax = vertices[0].Position;
+    for (size_t i = 0; i < count; i++) {
+        boundsMin = glm::min(boundsMin, vertices[i].Position);
+        boundsMax = glm::max(boundsMax, vertices[i].Position);
+    }
+    error.vertices = count;
+    for (size_t i = 0; i < count; i++) {
+        PackedVertex packed;
+        packVertices(&vertices[i], 1, boundsMin, boundsMax, &packed);
+        Vertex decoded = unpackVertex(packed, boundsMin, boundsMax);
+
+        double position = glm::length(decoded.Position - vertices[i].Position);
+        error.positionMax = std::max(error.positionMax, position);
+        error.positionSum += position;
+        double texCoord = glm::length(decoded.TexCoords - vertices[i].TexCoords);
+        error.texCoordMax = std::max(error.texCoordMax, texCoord);
+        error.texCoordSum += texCoord;
+        glm::dvec3 original(vertices[i].Normal), unpacked(decoded.Normal);
+        if (glm::length(original) > 0.0) {
+            // atan2 stays accurate for the tiny angles involved, acos does not
+            double normal = glm::degrees(std::atan2(glm::length(glm::cross(original, unpacked)),
+                                                    glm::dot(original, unpacked)));
+            error.normalMax = std::max(error.normalMax, normal);
+            error.normalSum += normal;
+            error.normals++;
+        }
+    }
+    return error;
+}
+
+#endif